@@ -8,6 +8,10 @@
 #include <new>
 #include <cstdint>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 namespace jpl {
 
 namespace detail {
@@ -69,6 +73,67 @@ struct aligned_allocator {
 	}
 };
 
+// Takes memory straight from the OS, in whole pages. Allocations of at least a huge page are aligned to one, and on
+// Linux advised to be backed by transparent huge pages, which cuts TLB misses when something large is accessed all
+// over, like a big ring buffer. Elsewhere it falls back to page aligned operator new.
+// Small allocations still take a whole page, so this is only worth it for large, long lived buffers.
+template<class T>
+struct huge_page_allocator {
+	using value_type = T;
+	static constexpr ::size_t page_size{ 4096 };
+	static constexpr ::size_t huge_page_size{ 2 * 1024 * 1024 };
+
+	static T* allocate(::size_t n) {
+		if (n >= (UINT64_MAX - 2 * huge_page_size) / sizeof(T)) [[unlikely]] detail::throw_bad_alloc();
+		const ::size_t size = mapped_size(n);
+		#ifdef __linux__
+		if (size < huge_page_size) {
+			void* mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mem == MAP_FAILED) [[unlikely]] detail::throw_bad_alloc();
+			return static_cast<T*>(mem);
+		}
+		// Map an extra huge page, and trim it off the ends to get the alignment
+		void* mem = ::mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED) [[unlikely]] detail::throw_bad_alloc();
+		const ::uintptr_t begin = reinterpret_cast<::uintptr_t>(mem);
+		const ::uintptr_t aligned = (begin + huge_page_size - 1) & ~(huge_page_size - 1);
+		if (aligned != begin)
+			::munmap(mem, aligned - begin);
+		if (const ::size_t after = huge_page_size - (aligned - begin))
+			::munmap(reinterpret_cast<void*>(aligned + size), after);
+		// Only advice, so if THP is disabled, this is just regular pages
+		::madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+		return reinterpret_cast<T*>(aligned);
+		#else
+		return static_cast<T*>(::operator new(size, ::std::align_val_t{ size < huge_page_size ? page_size : huge_page_size }));
+		#endif
+	}
+	static T* reallocate(void* old_ptr, ::size_t n, ::size_t old_n) {
+		T* mem = allocate(n);
+		// A vector that has never allocated passes nullptr
+		if (old_ptr) {
+			::memcpy(mem, old_ptr, (n < old_n ? n : old_n) * sizeof(T));
+			deallocate(old_ptr, old_n);
+		}
+		return mem;
+	}
+	static void deallocate(void* ptr, ::size_t n) {
+		#ifdef __linux__
+		::munmap(ptr, mapped_size(n));
+		#else
+		const ::size_t size = mapped_size(n);
+		::operator delete(ptr, ::std::align_val_t{ size < huge_page_size ? page_size : huge_page_size });
+		#endif
+	}
+
+	private:
+	static constexpr ::size_t mapped_size(::size_t n) noexcept {
+		const ::size_t size = n ? n * sizeof(T) : 1;
+		const ::size_t granularity = size < huge_page_size ? page_size : huge_page_size;
+		return (size + granularity - 1) & ~(granularity - 1);
+	}
+};
+
 namespace detail {
 
 template<class T>
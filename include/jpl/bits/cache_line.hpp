@@ -0,0 +1,19 @@
+#ifndef JPL_BITS_CACHE_LINE_HPP
+#define JPL_BITS_CACHE_LINE_HPP
+
+#include <cstddef>
+#include <new>
+
+namespace jpl {
+
+#ifdef __cpp_lib_hardware_interference_size
+	using ::std::hardware_destructive_interference_size;
+#elif defined(JPL_CACHE_LINE_SIZE)
+	inline constexpr ::size_t hardware_destructive_interference_size{ JPL_CACHE_LINE_SIZE };
+#else
+	inline constexpr ::size_t hardware_destructive_interference_size{ 64 };
+#endif
+
+} // namespace jpl
+
+#endif // JPL_BITS_CACHE_LINE_HPP
@@ -0,0 +1,22 @@
+#ifndef JPL_BITS_CPU_RELAX_HPP
+#define JPL_BITS_CPU_RELAX_HPP
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace jpl::detail {
+
+// Spin loop hint. Lets the other hyperthread on the core run, and avoids the memory order mis-speculation penalty
+// when the loop finally exits.
+[[gnu::always_inline]] inline void cpu_relax() noexcept {
+	#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	::_mm_pause();
+	#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield" ::: "memory");
+	#endif
+}
+
+} // namespace jpl::detail
+
+#endif // JPL_BITS_CPU_RELAX_HPP
@@ -0,0 +1,84 @@
+#ifndef JPL_BITS_EVENTCOUNT_HPP
+#define JPL_BITS_EVENTCOUNT_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <jpl/bits/cache_line.hpp>
+#include <jpl/bits/futex.hpp>
+
+namespace jpl::detail {
+
+// Lets any number of threads sleep until a condition becomes true, on a single shared futex word, so that notifying
+// costs no syscall unless someone is actually asleep.
+//
+// Waiting goes:
+//     const ::uint32_t key = ec.prepare_wait();
+//     if (condition()) ec.cancel_wait(); else ec.wait(key);
+// and then checking the condition again, since waking up doesn't guarantee it, and another waiter may have gotten to
+// it first. Notifying is making the condition true, and then calling notify.
+// The fences in prepare_wait and notify pair up, so that either the waiter sees the condition, or the notifier sees
+// the waiter. Every notify that wakes someone bumps the epoch, so a waiter that prepared before it doesn't go to sleep.
+// Wakes that haven't been picked up yet are counted, so that until a woken waiter gets to run, notify doesn't make
+// the syscall again for it.
+struct alignas(hardware_destructive_interference_size) eventcount {
+	// Registered waiters in the low half, and wakes sent to them that they haven't picked up yet in the high half.
+	// Both are in one word, so that notify never sees one of them updated without the other.
+	::std::atomic<::uint64_t> state{ 0 };
+	::std::atomic<::uint32_t> epoch{ 0 };
+
+	[[nodiscard]] ::uint32_t prepare_wait() noexcept {
+		state.fetch_add(1, ::std::memory_order::relaxed);
+		::std::atomic_thread_fence(::std::memory_order::seq_cst);
+		return epoch.load(::std::memory_order::acquire);
+	}
+
+	void cancel_wait() noexcept {
+		leave();
+	}
+
+	void wait(::uint32_t key) noexcept {
+		::jpl::detail::futex_wait(epoch, key);
+		leave();
+	}
+
+	void wait_for(::uint32_t key, ::std::chrono::nanoseconds timeout) noexcept {
+		::jpl::detail::futex_wait_for(epoch, key, timeout);
+		leave();
+	}
+
+	// Wakes up to n sleeping waiters
+	[[gnu::always_inline]] void notify(::uint32_t n) noexcept {
+		::std::atomic_thread_fence(::std::memory_order::seq_cst);
+		::uint64_t s = state.load(::std::memory_order::relaxed);
+		if (::uint32_t(s) == 0) [[likely]]
+			return;
+		notify_slow(s, n);
+	}
+
+	private:
+	[[gnu::noinline]] void notify_slow(::uint64_t s, ::uint32_t n) noexcept {
+		::uint32_t k;
+		do {
+			const ::uint32_t n_waiting = ::uint32_t(s), n_woken = ::uint32_t(s >> 32);
+			if (n_woken >= n_waiting)
+				return;
+			k = n < n_waiting - n_woken ? n : n_waiting - n_woken;
+		} while (!state.compare_exchange_weak(s, s + (::uint64_t(k) << 32), ::std::memory_order::relaxed));
+		epoch.fetch_add(1, ::std::memory_order::release);
+		::jpl::detail::futex_wake(epoch, int(k));
+	}
+
+	// Whether or not this waiter was the one a wake was meant for, it takes one, since it's going to check the
+	// condition anyway. Taking too many only costs extra syscalls, but leaving one behind could make notify skip a
+	// sleeper.
+	void leave() noexcept {
+		::uint64_t s = state.load(::std::memory_order::relaxed);
+		while (!state.compare_exchange_weak(s, s - 1 - ((s >> 32) ? (::uint64_t(1) << 32) : 0), ::std::memory_order::relaxed));
+	}
+};
+
+} // namespace jpl::detail
+
+#endif // JPL_BITS_EVENTCOUNT_HPP
@@ -0,0 +1,81 @@
+#ifndef JPL_BITS_FUTEX_HPP
+#define JPL_BITS_FUTEX_HPP
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#elif defined(_MSC_VER)
+#define WIN32_LEAN_AND_MEAN
+#include "windows.h"
+#include "synchapi.h"
+#else
+#error "jpl futex wrappers are only supported on Linux and Windows"
+#endif
+
+namespace jpl::detail {
+
+// Thin wrappers over the platform's address-based wait, so that the queues and the thread pool don't have to repeat
+// the #ifdef mess.
+
+#ifdef JPL_COUNT_FUTEX_CALLS
+// Number of wait and wake syscalls made through the wrappers below, for benchmarks. If the macro is defined, it has to
+// be defined for the whole program.
+inline ::std::atomic<::uint64_t> futex_wait_calls{ 0 };
+inline ::std::atomic<::uint64_t> futex_wake_calls{ 0 };
+#endif
+
+// Blocks while word == expected. Can wake up spuriously, so the caller must always re-check its condition.
+[[gnu::always_inline]] inline void futex_wait(::std::atomic<::uint32_t>& word, ::uint32_t expected) noexcept {
+	#ifdef JPL_COUNT_FUTEX_CALLS
+	futex_wait_calls.fetch_add(1, ::std::memory_order::relaxed);
+	#endif
+	#ifdef __linux__
+	::syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+	#elif defined(_MSC_VER)
+	::WaitOnAddress(&word, &expected, 4, INFINITE);
+	#endif
+}
+
+// Like futex_wait, but gives up after timeout
+inline void futex_wait_for(::std::atomic<::uint32_t>& word, ::uint32_t expected, ::std::chrono::nanoseconds timeout) noexcept {
+	if (timeout <= ::std::chrono::nanoseconds::zero())
+		return;
+	#ifdef JPL_COUNT_FUTEX_CALLS
+	futex_wait_calls.fetch_add(1, ::std::memory_order::relaxed);
+	#endif
+	#ifdef __linux__
+	const ::timespec ts{
+		.tv_sec  = ::time_t(timeout.count() / 1'000'000'000),
+		.tv_nsec = long(timeout.count() % 1'000'000'000),
+	};
+	::syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+	#elif defined(_MSC_VER)
+	// Rounded up, so that waiting for less than a millisecond doesn't turn into polling
+	::WaitOnAddress(&word, &expected, 4, DWORD((timeout.count() + 999'999) / 1'000'000));
+	#endif
+}
+
+[[gnu::always_inline]] inline void futex_wake(::std::atomic<::uint32_t>& word, int n_waiters = INT_MAX) noexcept {
+	#ifdef JPL_COUNT_FUTEX_CALLS
+	futex_wake_calls.fetch_add(1, ::std::memory_order::relaxed);
+	#endif
+	#ifdef __linux__
+	::syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, n_waiters, nullptr, nullptr, 0);
+	#elif defined(_MSC_VER)
+	if (n_waiters == 1)
+		::WakeByAddressSingle(&word);
+	else
+		::WakeByAddressAll(&word);
+	#endif
+}
+
+} // namespace jpl::detail
+
+#endif // JPL_BITS_FUTEX_HPP
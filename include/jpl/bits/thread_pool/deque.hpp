@@ -0,0 +1,113 @@
+#ifndef JPL_BITS_THREAD_POOL_DEQUE_HPP
+#define JPL_BITS_THREAD_POOL_DEQUE_HPP
+
+#include <jpl/bits/cache_line.hpp>
+#include <jpl/bits/trivially_relocatable.hpp>
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+namespace jpl::tp::detail {
+
+// Bounded Chase-Lev work-stealing deque.
+// The owner thread pushes and pops at the bottom (LIFO), any other thread can steal from the top (FIFO).
+// The buffer never grows. When it's full, push() fails and the caller is expected to fall back to the shared queue.
+// Memory orders follow "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al. 2013).
+template<class T, ::uint32_t size>
+	requires(
+		(::std::popcount(size) == 1)
+		// steal() copies the element before it knows whether it won the race for it, so the copy must be
+		// discardable without running any destructor.
+		&& ::jpl::trivially_relocatable<T>
+		&& ::std::is_nothrow_move_constructible_v<T>
+		&& ::std::is_nothrow_move_assignable_v<T>
+	)
+class work_stealing_deque {
+	struct slot {
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	alignas(hardware_destructive_interference_size) ::std::atomic<::int64_t> top{ 0 };
+	alignas(hardware_destructive_interference_size) ::std::atomic<::int64_t> bottom{ 0 };
+	alignas(hardware_destructive_interference_size) slot buffer[size];
+
+	[[gnu::always_inline]] T* get(::int64_t i) noexcept {
+		return ::std::launder(reinterpret_cast<T*>(buffer[i & (size - 1)].storage));
+	}
+
+	public:
+	work_stealing_deque() noexcept = default;
+	~work_stealing_deque() noexcept {
+		for (::int64_t i = top.load(), end = bottom.load(); i < end; ++i)
+			get(i)->~T();
+	}
+
+	work_stealing_deque(const work_stealing_deque&) = delete;
+	work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+	// Owner only
+	[[nodiscard]] bool push(T&& val) noexcept {
+		const ::int64_t b = bottom.load(::std::memory_order::relaxed);
+		const ::int64_t t = top.load(::std::memory_order::acquire);
+		if (b - t >= ::int64_t(size)) [[unlikely]]
+			return false;
+		::new (buffer[b & (size - 1)].storage) T{ static_cast<T&&>(val) };
+		::std::atomic_thread_fence(::std::memory_order::release);
+		bottom.store(b + 1, ::std::memory_order::relaxed);
+		return true;
+	}
+
+	// Owner only
+	[[nodiscard]] bool pop(T& out) noexcept {
+		const ::int64_t b = bottom.load(::std::memory_order::relaxed) - 1;
+		bottom.store(b, ::std::memory_order::relaxed);
+		::std::atomic_thread_fence(::std::memory_order::seq_cst);
+		::int64_t t = top.load(::std::memory_order::relaxed);
+		if (t > b) {
+			bottom.store(b + 1, ::std::memory_order::relaxed);
+			return false;
+		}
+		// Last element, so race against thieves for it
+		if (t == b) {
+			const bool won = top.compare_exchange_strong(t, t + 1, ::std::memory_order::seq_cst, ::std::memory_order::relaxed);
+			bottom.store(b + 1, ::std::memory_order::relaxed);
+			if (!won)
+				return false;
+		}
+		T* ptr = get(b);
+		out = static_cast<T&&>(*ptr);
+		ptr->~T();
+		return true;
+	}
+
+	// Any thread
+	[[nodiscard]] bool steal(T& out) noexcept {
+		::int64_t t = top.load(::std::memory_order::acquire);
+		::std::atomic_thread_fence(::std::memory_order::seq_cst);
+		const ::int64_t b = bottom.load(::std::memory_order::acquire);
+		if (t >= b)
+			return false;
+		// The owner may overwrite the slot while it's being copied, but in that case top has already moved,
+		// and the CAS below fails, so the torn copy is simply dropped.
+		slot copy;
+		::memcpy(copy.storage, buffer[t & (size - 1)].storage, sizeof(T));
+		if (!top.compare_exchange_strong(t, t + 1, ::std::memory_order::seq_cst, ::std::memory_order::relaxed))
+			return false;
+		T* ptr = ::std::launder(reinterpret_cast<T*>(copy.storage));
+		out = static_cast<T&&>(*ptr);
+		ptr->~T();
+		return true;
+	}
+
+	// Only a hint. The result can be stale before the caller gets to look at it.
+	bool empty() const noexcept {
+		return bottom.load(::std::memory_order::relaxed) <= top.load(::std::memory_order::relaxed);
+	}
+};
+
+} // namespace jpl::tp::detail
+
+#endif // JPL_BITS_THREAD_POOL_DEQUE_HPP
@@ -7,8 +7,13 @@ namespace jpl::tp {
 
 using clock = ::std::chrono::steady_clock;
 
-void init_io();
+struct conf;
+
+// Sets up the ring, and registers the buffers and file table it's configured with
+void init_io(const conf& config);
 void process_io(clock::duration timeout);
+// Whether process_io has anything to wait for. Only meaningful on the thread that processes IO.
+bool io_pending() noexcept;
 void free_io();
 
 } // namespace jpl::tp
@@ -0,0 +1,205 @@
+#ifndef JPL_BITS_THREAD_POOL_LAZY_HPP
+#define JPL_BITS_THREAD_POOL_LAZY_HPP
+
+#include <jpl/bits/trivially_relocatable.hpp>
+
+#include <cassert>
+#include <exception>
+#include <new>
+#include <type_traits>
+
+// Expects <coroutine> (or the experimental one, aliased into std) to be included already, see thread_pool.hpp
+
+namespace jpl::tp {
+
+template<class T = void>
+class lazy;
+
+namespace detail {
+
+struct lazy_promise_base {
+	::std::coroutine_handle<> continuation;
+	::std::exception_ptr exception;
+
+	// Resumes whoever awaited this coroutine, without going through the thread pool.
+	// A top level coroutine with nobody waiting for it simply stays suspended until its lazy is destroyed.
+	struct final_awaiter {
+		static constexpr bool await_ready() noexcept { return false; }
+		template<class P>
+		::std::coroutine_handle<> await_suspend(::std::coroutine_handle<P> handle) noexcept {
+			::std::coroutine_handle<> continuation = handle.promise().continuation;
+			return continuation ? continuation : ::std::noop_coroutine();
+		}
+		static constexpr void await_resume() noexcept {}
+	};
+
+	static constexpr ::std::suspend_always initial_suspend() noexcept { return {}; }
+	static constexpr final_awaiter final_suspend() noexcept { return {}; }
+
+	void unhandled_exception() noexcept {
+		exception = ::std::current_exception();
+	}
+
+	void rethrow_if_exception() {
+		if (exception) [[unlikely]]
+			::std::rethrow_exception(exception);
+	}
+};
+
+template<class T>
+struct lazy_promise : lazy_promise_base {
+	union { T value; };
+	bool has_value{ false };
+
+	lazy_promise() noexcept {}
+	~lazy_promise() {
+		if (has_value)
+			value.~T();
+	}
+
+	lazy<T> get_return_object() noexcept;
+
+	template<class U> requires ::std::is_constructible_v<T, U&&>
+	void return_value(U&& val) noexcept(::std::is_nothrow_constructible_v<T, U&&>) {
+		::new (&value) T(static_cast<U&&>(val));
+		has_value = true;
+	}
+
+	T&& result() {
+		rethrow_if_exception();
+		return static_cast<T&&>(value);
+	}
+};
+
+template<>
+struct lazy_promise<void> : lazy_promise_base {
+	lazy<void> get_return_object() noexcept;
+	static constexpr void return_void() noexcept {}
+	void result() {
+		rethrow_if_exception();
+	}
+};
+
+} // namespace detail
+
+// Lazily started coroutine that produces a T. Nothing runs until it's awaited, and when it finishes, the awaiting
+// coroutine is resumed directly on the same thread (symmetric transfer), so a chain of co_awaits never touches the
+// task queues, and can be arbitrarily deep without growing the stack.
+//
+// The lazy owns the coroutine frame. Since the frame is destroyed when a lazy that was awaited as a temporary goes
+// out of scope, and the handle never escapes, the compiler is free to allocate child frames inside the parent's
+// frame (Clang does this at -O2).
+//
+// Use tp::spawn() to start a top level lazy<void> on the thread pool. An exception escaping it calls std::terminate.
+template<class T>
+class [[nodiscard]] lazy {
+	static_assert(!::std::is_reference_v<T>, "tp::lazy doesn't support references, return a pointer instead");
+
+	public:
+	using promise_type = detail::lazy_promise<T>;
+	using handle_type  = ::std::coroutine_handle<promise_type>;
+
+	private:
+	handle_type handle;
+
+	public:
+	lazy() noexcept : handle{ nullptr } {}
+	explicit lazy(handle_type handle) noexcept : handle{ handle } {}
+	lazy(lazy&& other) noexcept : handle{ other.handle } {
+		other.handle = nullptr;
+	}
+	lazy& operator=(lazy&& other) noexcept {
+		handle_type temp = handle;
+		handle = other.handle;
+		other.handle = temp;
+		return *this;
+	}
+	~lazy() noexcept {
+		if (handle) handle.destroy();
+	}
+
+	lazy(const lazy&) = delete;
+	lazy& operator=(const lazy&) = delete;
+
+	explicit operator bool() const noexcept { return bool(handle); }
+
+	bool done() const noexcept {
+		return !handle || handle.done();
+	}
+
+	// Only meant for starting coroutines from outside of coroutines. Gives up ownership of the frame.
+	handle_type release() noexcept {
+		handle_type temp = handle;
+		handle = nullptr;
+		return temp;
+	}
+
+	// The lazy must hold a coroutine, so not be default constructed, moved from or released
+	auto operator co_await() && noexcept {
+		struct awaiter {
+			handle_type handle;
+			bool await_ready() const noexcept {
+				assert(handle && "jpl::tp::lazy awaited without a coroutine");
+				return handle.done();
+			}
+			::std::coroutine_handle<> await_suspend(::std::coroutine_handle<> awaiting) noexcept {
+				handle.promise().continuation = awaiting;
+				return handle;
+			}
+			decltype(auto) await_resume() {
+				return handle.promise().result();
+			}
+		};
+		return awaiter{ handle };
+	}
+
+	auto operator co_await() & noexcept {
+		return static_cast<lazy&&>(*this).operator co_await();
+	}
+};
+
+namespace detail {
+
+template<class T>
+inline lazy<T> lazy_promise<T>::get_return_object() noexcept {
+	return lazy<T>{ ::std::coroutine_handle<lazy_promise<T>>::from_promise(*this) };
+}
+
+inline lazy<void> lazy_promise<void>::get_return_object() noexcept {
+	return lazy<void>{ ::std::coroutine_handle<lazy_promise<void>>::from_promise(*this) };
+}
+
+// Frame of a spawned lazy. It destroys itself when the lazy finishes, since nobody is left to own it.
+struct detached {
+	struct promise_type {
+		detached get_return_object() noexcept {
+			return { ::std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+		static constexpr ::std::suspend_always initial_suspend() noexcept { return {}; }
+		static constexpr ::std::suspend_never  final_suspend()   noexcept { return {}; }
+		static constexpr void return_void() noexcept {}
+		// There's nobody to report it to, and rethrowing it would unwind the worker that resumed the coroutine, leaking
+		// the frame and taking the pool down with it, so it's fatal. Spawned coroutines have to catch their own
+		// exceptions, or run in a task_group, which hands the first one to its waiter.
+		[[noreturn]] static void unhandled_exception() noexcept { ::std::terminate(); }
+	};
+	::std::coroutine_handle<> handle;
+};
+
+inline detached run_detached(lazy<void> l) {
+	co_await static_cast<lazy<void>&&>(l);
+}
+
+} // namespace detail
+
+} // namespace jpl::tp
+
+namespace jpl {
+
+// Just a coroutine handle
+template<class T>
+inline constexpr bool trivially_relocatable<tp::lazy<T>> = true;
+
+} // namespace jpl
+
+#endif // JPL_BITS_THREAD_POOL_LAZY_HPP
@@ -0,0 +1,81 @@
+#ifndef JPL_BITS_THREAD_POOL_OVERFLOW_HPP
+#define JPL_BITS_THREAD_POOL_OVERFLOW_HPP
+
+#include <jpl/bits/cache_line.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+namespace jpl::tp::detail {
+
+// Unbounded FIFO that catches whatever doesn't fit in a fixed size ring buffer.
+// Producers are lock-free and never wait: a push is a single atomic exchange on the tail (Vyukov's MPSC queue).
+// Only one consumer can drain at a time, but consumers never wait either. If another thread is already
+// draining, try_drain() simply returns 0, and the caller can look for work elsewhere.
+template<class T>
+	requires(::std::is_nothrow_move_constructible_v<T> && ::std::is_nothrow_default_constructible_v<T>)
+class overflow_queue {
+	struct node {
+		::std::atomic<node*> next{ nullptr };
+		T val;
+	};
+
+	// head is a dummy node, and the first actual value lives in head->next
+	alignas(hardware_destructive_interference_size) ::std::atomic<node*> tail;
+	alignas(hardware_destructive_interference_size) node* head;
+	::std::atomic<bool> draining{ false };
+	alignas(hardware_destructive_interference_size) ::std::atomic<::uint64_t> depth{ 0 };
+
+	public:
+	overflow_queue() : tail{ new node{} }, head{ tail.load() } {}
+	~overflow_queue() noexcept {
+		while (head) {
+			node* next = head->next.load();
+			delete head;
+			head = next;
+		}
+	}
+
+	overflow_queue(const overflow_queue&) = delete;
+	overflow_queue& operator=(const overflow_queue&) = delete;
+
+	void push(T&& val) {
+		node* n = new node{ {}, static_cast<T&&>(val) };
+		// Count before publishing, so that depth never underflows
+		depth.fetch_add(1, ::std::memory_order::relaxed);
+		node* prev = tail.exchange(n, ::std::memory_order::acq_rel);
+		prev->next.store(n, ::std::memory_order::release);
+	}
+
+	// Pops up to max values in FIFO order, and passes them to sink(T&), which returns false to stop draining.
+	// A value that sink returns false for is left at the front of the queue.
+	// Returns the number of values consumed, which is 0 if the queue was empty, or another thread was draining.
+	template<class F>
+	::size_t try_drain(::size_t max, F&& sink) noexcept {
+		if (!depth.load(::std::memory_order::relaxed) || draining.exchange(true, ::std::memory_order::acquire))
+			return 0;
+		::size_t n = 0;
+		for (; n != max; ++n) {
+			// A producer that has done the exchange but not yet linked its node looks like the end of the queue.
+			// That's fine, since it will be seen on the next drain.
+			node* next = head->next.load(::std::memory_order::acquire);
+			if (!next || !sink(next->val))
+				break;
+			delete head;
+			head = next;
+		}
+		depth.fetch_sub(n, ::std::memory_order::relaxed);
+		draining.store(false, ::std::memory_order::release);
+		return n;
+	}
+
+	// Only a hint, like anything else in a multi-producer multi-consumer setting
+	::uint64_t size() const noexcept {
+		return depth.load(::std::memory_order::relaxed);
+	}
+};
+
+} // namespace jpl::tp::detail
+
+#endif // JPL_BITS_THREAD_POOL_OVERFLOW_HPP
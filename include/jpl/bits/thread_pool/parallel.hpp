@@ -0,0 +1,158 @@
+#ifndef JPL_BITS_THREAD_POOL_PARALLEL_HPP
+#define JPL_BITS_THREAD_POOL_PARALLEL_HPP
+
+#include <jpl/thread_pool.hpp>
+#include <jpl/bits/cache_line.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+
+namespace jpl::tp {
+
+namespace detail {
+
+// Ranges are split with lazy binary splitting: a task works through its range grain elements at a time, and only
+// splits off the upper half of what's left when should_split() says someone could take it. Splits go to the worker's
+// own deque, where idle workers steal them, so the amount of splitting adapts to how busy the pool is, instead of
+// being decided up front.
+template<class Body>
+struct split_state {
+	task_group group{};
+	Body& body;
+	::size_t grain;
+};
+
+template<class Body>
+void split_run(split_state<Body>& state, ::size_t first, ::size_t last) {
+	while (last - first > state.grain) {
+		if (last - first >= 2 * state.grain && should_split()) {
+			const ::size_t middle = first + (last - first) / 2;
+			state.group.run([&state, middle, last] { split_run(state, middle, last); });
+			last = middle;
+			continue;
+		}
+		state.body(first, first + state.grain);
+		first += state.grain;
+	}
+	state.body(first, last);
+}
+
+// Aims for a few dozen chunks per thread, which is plenty for splitting to even out the load
+inline ::size_t auto_grain(::size_t n) noexcept {
+	const ::size_t grain = n / ((n_threads() + 1) * 32);
+	return grain ? grain : 1;
+}
+
+// Calls body(first, last) on subranges of [first, last), and returns once all of them have been processed.
+// The calling thread takes part: a worker starts on the range itself, and any thread helps with queued tasks while
+// waiting for the rest.
+template<class Body>
+void parallel_chunks(::size_t first, ::size_t last, ::size_t grain, Body&& body) {
+	if (first >= last)
+		return;
+	const ::size_t n = last - first;
+	if (!grain)
+		grain = auto_grain(n);
+	// Not worth a task, or there's no pool to run it on
+	if (n <= grain || n_threads() == 0) {
+		body(first, last);
+		return;
+	}
+	split_state<::std::remove_reference_t<Body>> state{ .body = body, .grain = grain };
+	if (thread_index() != n_threads()) {
+		split_run(state, first, last);
+	} else {
+		state.group.run([&state, first, last] { split_run(state, first, last); });
+	}
+	state.group.wait();
+}
+
+template<class R>
+concept index_range = ::std::ranges::random_access_range<R> && ::std::ranges::sized_range<R>;
+
+} // namespace detail
+
+// Calls func(i) for every i in [first, last), in parallel on the pool.
+//
+// grain is the smallest number of consecutive indices that are handed out at once, and ranges with at most grain
+// elements run inline on the calling thread. The default (0) picks one based on the number of threads. Cheap bodies
+// over short ranges should pass a bigger one, since each split costs about as much as a task.
+//
+// Blocks until every call has returned. If any of them throws, the first exception is rethrown after that.
+template<class F>
+void parallel_for(::size_t first, ::size_t last, F&& func, ::size_t grain = 0) {
+	detail::parallel_chunks(first, last, grain, [&func](::size_t b, ::size_t e) {
+		for (::size_t i = b; i != e; ++i)
+			func(i);
+	});
+}
+
+// Calls func(element) for every element of the range, like std::for_each, but in parallel on the pool
+template<detail::index_range R, class F>
+void parallel_for(R&& range, F&& func, ::size_t grain = 0) {
+	const auto begin = ::std::ranges::begin(range);
+	detail::parallel_chunks(0, ::std::ranges::size(range), grain, [&func, begin](::size_t b, ::size_t e) {
+		using difference = ::std::iter_difference_t<decltype(begin)>;
+		for (auto it = begin + difference(b), end = begin + difference(e); it != end; ++it)
+			func(*it);
+	});
+}
+
+// Folds the range with acc = op(acc, element), in parallel on the pool, and merges the partial results with
+// combine(acc, acc).
+//
+// Every worker has its own accumulator, so op never synchronizes with other threads. Each chunk is folded into a local
+// starting from a copy of init, and merged into the worker's accumulator at the end of the chunk, so init has to be
+// an identity of combine. Since the order in which chunks land in accumulators depends on scheduling, combine has to
+// be associative and commutative, and op and combine together must not care how the range is split up.
+//
+//   const double sum = tp::parallel_reduce(values, 0.0,
+//       [](double acc, double v) { return acc + v * v; },
+//       [](double a, double b) { return a + b; });
+template<detail::index_range R, class T, class Op, class Combine>
+T parallel_reduce(R&& range, T init, Op&& op, Combine&& combine, ::size_t grain = 0) {
+	// Threads outside the pool share the last accumulator, so that one is behind a spinlock
+	struct alignas(hardware_destructive_interference_size) accumulator {
+		::std::optional<T> value;
+		::std::atomic<bool> locked{ false };
+	};
+
+	const ::size_t n_accumulators = n_threads() + 1;
+	const ::std::unique_ptr<accumulator[]> accumulators{ new accumulator[n_accumulators] };
+	const auto begin = ::std::ranges::begin(range);
+
+	detail::parallel_chunks(0, ::std::ranges::size(range), grain, [&](::size_t b, ::size_t e) {
+		using difference = ::std::iter_difference_t<decltype(begin)>;
+		T acc = init;
+		for (auto it = begin + difference(b), end = begin + difference(e); it != end; ++it)
+			acc = op(static_cast<T&&>(acc), *it);
+
+		// The pool could have grown since the accumulators were allocated
+		const ::size_t idx = thread_index();
+		accumulator& target = accumulators[idx < n_accumulators - 1 ? idx : n_accumulators - 1];
+		const bool shared = (&target == &accumulators[n_accumulators - 1]);
+		if (shared)
+			while (target.locked.exchange(true, ::std::memory_order::acquire));
+		if (target.value)
+			*target.value = combine(static_cast<T&&>(*target.value), static_cast<T&&>(acc));
+		else
+			target.value.emplace(static_cast<T&&>(acc));
+		if (shared)
+			target.locked.store(false, ::std::memory_order::release);
+	});
+
+	T result = static_cast<T&&>(init);
+	for (::size_t i = 0; i != n_accumulators; ++i)
+		if (accumulators[i].value)
+			result = combine(static_cast<T&&>(result), static_cast<T&&>(*accumulators[i].value));
+	return result;
+}
+
+} // namespace jpl::tp
+
+#endif // JPL_BITS_THREAD_POOL_PARALLEL_HPP
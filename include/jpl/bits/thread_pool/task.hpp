@@ -4,8 +4,12 @@
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <new>
 #include <type_traits>
 
+#include <jpl/bits/trivially_relocatable.hpp>
+
 namespace jpl::tp {
 
 using clock = std::chrono::steady_clock;
@@ -99,15 +103,14 @@ class task {
 	}
 };
 
-struct timed_task {
-	task t;
-	clock::time_point queue_at;
+} // namespace jpl::tp
 
-	bool operator<(const timed_task& other) const noexcept {
-		return queue_at < other.queue_at;
-	}
-};
+namespace jpl {
 
-} // namespace jpl::tp
+// task's move operations are plain memcpy, so relocating it bytewise is always fine
+template<>
+inline constexpr bool trivially_relocatable<tp::task> = true;
+
+} // namespace jpl
 
 #endif // JPL_THREAD_POOL_TASK_HPP
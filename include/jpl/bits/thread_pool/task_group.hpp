@@ -0,0 +1,156 @@
+#ifndef JPL_BITS_THREAD_POOL_TASK_GROUP_HPP
+#define JPL_BITS_THREAD_POOL_TASK_GROUP_HPP
+
+#include <jpl/thread_pool.hpp>
+#include <jpl/bits/futex.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+
+namespace jpl::tp {
+
+// Tracks its own tasks, so that a caller can wait for just those, instead of everything in the pool like join() does.
+//
+//   tp::task_group group;
+//   for (auto& item : items)
+//       group.run([&]{ process(item); });
+//   group.wait();        // or co_await group;
+//
+// Tasks can add more tasks to their own group while it's being waited for. If tasks throw, the first exception is
+// rethrown from wait() or co_await, after every task has finished. A group can be reused after waiting.
+//
+// Only one thread or coroutine can wait for a group at a time.
+class task_group {
+	// Outstanding tasks, plus one for the owner while it isn't waiting.
+	// The owner drops its count when it starts waiting, so whoever brings the count to zero knows to wake it up.
+	// A coroutine waiting also sets awaiting_bit, so the last task knows to resume it instead of notifying.
+	static constexpr ::uint32_t awaiting_bit{ 1u << 31 };
+	::std::atomic<::uint32_t> count{ 1 };
+	::std::atomic<bool> failed{ false };
+	::std::coroutine_handle<> awaiting;
+	::std::exception_ptr exception;
+
+	void finish() noexcept {
+		const ::uint32_t prev = count.fetch_sub(1, ::std::memory_order::acq_rel);
+		if ((prev & ~awaiting_bit) != 1)
+			return;
+		if (prev & awaiting_bit) {
+			const ::std::coroutine_handle<> handle = awaiting;
+			count.store(1, ::std::memory_order::relaxed);
+			handle.resume();
+		} else {
+			// The waiter may already be gone by the time this runs, which is fine, since it only wakes up the address
+			::jpl::detail::futex_wake(count);
+		}
+	}
+
+	void fail() noexcept {
+		if (!failed.exchange(true, ::std::memory_order::acq_rel))
+			exception = ::std::current_exception();
+	}
+
+	void rethrow_if_failed() {
+		if (failed.load(::std::memory_order::acquire)) [[unlikely]] {
+			::std::exception_ptr err = static_cast<::std::exception_ptr&&>(exception);
+			exception = nullptr;
+			failed.store(false, ::std::memory_order::relaxed);
+			::std::rethrow_exception(err);
+		}
+	}
+
+	static lazy<void> run_lazy(task_group& group, lazy<void> l) {
+		try {
+			co_await static_cast<lazy<void>&&>(l);
+		} catch (...) {
+			group.fail();
+		}
+		group.finish();
+	}
+
+	public:
+	task_group() noexcept = default;
+	// Waits for the remaining tasks, but swallows their exceptions, since there's no one to report them to
+	~task_group() noexcept {
+		if (count.load(::std::memory_order::acquire) != 1) {
+			try { wait(); } catch (...) {}
+		}
+	}
+
+	task_group(const task_group&) = delete;
+	task_group& operator=(const task_group&) = delete;
+
+	void run(priority p, auto&& func, auto&& ... args) noexcept {
+		count.fetch_add(1, ::std::memory_order::relaxed);
+		::jpl::tp::enqueue(p, [this, func = static_cast<decltype(func)&&>(func), ...args = static_cast<decltype(args)&&>(args)]() mutable noexcept {
+			try {
+				static_cast<decltype(func)&&>(func)(static_cast<decltype(args)&&>(args)...);
+			} catch (...) {
+				fail();
+			}
+			finish();
+		});
+	}
+
+	void run(auto&& func, auto&& ... args) noexcept
+		requires(!::std::is_same_v<::std::remove_cvref_t<decltype(func)>, priority>)
+	{
+		run(priority::normal, static_cast<decltype(func)&&>(func), static_cast<decltype(args)&&>(args)...);
+	}
+
+	// The group's count includes the coroutine until it has finished, including time spent suspended
+	void spawn(priority p, lazy<void>&& l) noexcept {
+		count.fetch_add(1, ::std::memory_order::relaxed);
+		::jpl::tp::spawn(p, run_lazy(*this, static_cast<lazy<void>&&>(l)));
+	}
+
+	void spawn(lazy<void>&& l) noexcept {
+		spawn(priority::normal, static_cast<lazy<void>&&>(l));
+	}
+
+	// Runs other queued tasks while waiting, and only blocks when there's nothing left to help with.
+	// If no other thread is processing IO and timers (see join()), the waiting thread does it, since the group's
+	// tasks might depend on them.
+	void wait() {
+		if (count.fetch_sub(1, ::std::memory_order::acq_rel) != 1) {
+			for (;;) {
+				const ::uint32_t n = count.load(::std::memory_order::acquire);
+				if (n == 0)
+					break;
+				if (detail::try_run_task())
+					continue;
+				if (!detail::try_process_events(::std::chrono::milliseconds{ 5 }, &count, n))
+					::jpl::detail::futex_wait(count, n);
+			}
+		}
+		count.store(1, ::std::memory_order::relaxed);
+		rethrow_if_failed();
+	}
+
+	// The last task to finish resumes the awaiting coroutine directly on its own thread
+	auto operator co_await() noexcept {
+		struct awaiter {
+			task_group& group;
+			bool await_ready() const noexcept {
+				return group.count.load(::std::memory_order::acquire) == 1;
+			}
+			bool await_suspend(::std::coroutine_handle<> handle) noexcept {
+				group.awaiting = handle;
+				const ::uint32_t prev = group.count.fetch_add(awaiting_bit - 1, ::std::memory_order::acq_rel);
+				if (prev != 1)
+					return true;
+				// Everything finished in the meantime
+				group.count.store(1, ::std::memory_order::relaxed);
+				return false;
+			}
+			void await_resume() {
+				group.rethrow_if_failed();
+			}
+		};
+		return awaiter{ *this };
+	}
+};
+
+} // namespace jpl::tp
+
+#endif // JPL_BITS_THREAD_POOL_TASK_GROUP_HPP
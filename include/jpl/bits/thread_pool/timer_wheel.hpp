@@ -0,0 +1,280 @@
+#ifndef JPL_BITS_THREAD_POOL_TIMER_WHEEL_HPP
+#define JPL_BITS_THREAD_POOL_TIMER_WHEEL_HPP
+
+#include <jpl/bits/cache_line.hpp>
+#include <jpl/bits/thread_pool/task.hpp>
+
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+
+namespace jpl::tp::detail {
+
+struct timer_node {
+	enum : ::uint32_t { pending, fired, cancelled };
+	static constexpr ::uint8_t unlinked{ 0xff };
+
+	timer_node* next{ nullptr };
+	timer_node* prev{ nullptr };
+	timer_node* cancel_next{ nullptr };
+	::uint64_t expiry{ 0 }; // in ticks since timer_wheel::epoch
+	task t;
+	::std::atomic<::uint32_t> state{ pending };
+	// Nodes embedded in awaiters aren't reference counted, and can't be cancelled.
+	// Heap allocated nodes start with one reference for the wheel and one for the tp::timer handle.
+	::std::atomic<::uint32_t> refs{ 0 };
+	::uint8_t level{ unlinked };
+	::uint8_t slot{ 0 };
+
+	void release() noexcept {
+		if (refs.fetch_sub(1, ::std::memory_order::acq_rel) == 1)
+			delete this;
+	}
+};
+
+// Hierarchical timing wheel, with 6 levels of 64 slots, so with 1ms resolution it covers ~2 years before
+// timers need to be re-inserted.
+// Level n slots are 64^n ticks wide. When the wheel reaches a slot on a higher level, the timers in it are cascaded
+// to lower levels, so every timer is touched at most once per level, and insert/unlink are O(1).
+//
+// Any thread can schedule or cancel timers. Those only push the node onto an intrusive lock-free stack: schedule()
+// to one of n_shards insertion buffers (ideally one per thread), and cancel() to a shared cancellation list.
+// The wheel itself is only touched by whichever thread is running process(). Others calling it at the same time
+// simply return, so nobody ever waits for the wheel.
+class timer_wheel {
+	public:
+	static constexpr clock::duration resolution{ ::std::chrono::milliseconds{ 1 } };
+	static constexpr ::uint32_t level_bits{ 6 };
+	static constexpr ::uint32_t n_slots{ 1u << level_bits };
+	static constexpr ::uint32_t n_levels{ 6 };
+	static constexpr ::uint64_t max_range{ 1ull << (level_bits * n_levels) };
+	static constexpr ::size_t n_shards{ 64 };
+
+	private:
+	struct alignas(hardware_destructive_interference_size) shard {
+		::std::atomic<timer_node*> head{ nullptr };
+	};
+
+	shard inserts[n_shards];
+	alignas(hardware_destructive_interference_size) ::std::atomic<timer_node*> cancels{ nullptr };
+	alignas(hardware_destructive_interference_size) ::std::atomic<bool> busy{ false };
+	::std::atomic<::uint64_t> next_tick{ UINT64_MAX };
+	const clock::time_point epoch;
+	::uint64_t now{ 0 };
+	::uint64_t occupied[n_levels]{};
+	timer_node* slots[n_levels][n_slots]{};
+
+	static void push(::std::atomic<timer_node*>& head, timer_node* n, timer_node* timer_node::* link) noexcept {
+		n->*link = head.load(::std::memory_order::relaxed);
+		while (!head.compare_exchange_weak(n->*link, n, ::std::memory_order::release, ::std::memory_order::relaxed));
+	}
+
+	// The level is decided by the most significant bit that differs between now and expiry, which guarantees that
+	// a timer's slot is ahead of the current position on its level. The only exception is the top level, which
+	// also holds timers from the next rotation.
+	static ::uint32_t level_for(::uint64_t now, ::uint64_t expiry) noexcept {
+		const ::uint64_t masked = (now ^ expiry) | (n_slots - 1);
+		const ::uint32_t level = (63 - ::std::countl_zero(masked)) / level_bits;
+		return level < n_levels ? level : n_levels - 1;
+	}
+
+	// Tick at which the earliest occupied slot on the level is reached
+	::uint64_t slot_deadline(::uint32_t level) const noexcept {
+		const ::uint32_t shift = level * level_bits;
+		const ::uint32_t current = (now >> shift) & (n_slots - 1);
+		// On higher levels the current slot has already been cascaded, so if it's occupied, it's by the next rotation
+		const ::uint32_t from = (current + (level != 0)) & (n_slots - 1);
+		const ::uint32_t slot = (from + ::std::countr_zero(::std::rotr(occupied[level], from))) & (n_slots - 1);
+		const ::uint64_t level_range = 1ull << (shift + level_bits);
+		const ::uint64_t deadline = (now & ~(level_range - 1)) + (::uint64_t(slot) << shift);
+		return (deadline < now || (level != 0 && slot == current)) ? deadline + level_range : deadline;
+	}
+
+	::uint64_t earliest_deadline() const noexcept {
+		for (::uint32_t level = 0; level != n_levels; ++level)
+			if (occupied[level])
+				return slot_deadline(level);
+		return UINT64_MAX;
+	}
+
+	static void discard(timer_node* n) noexcept {
+		{ task dropped = static_cast<task&&>(n->t); }
+		// The task is never run, so it won't decrement the counter itself
+		pending_tasks--;
+		n->release();
+	}
+
+	template<class F>
+	static void fire(timer_node* n, F& sink) noexcept {
+		::uint32_t expected = timer_node::pending;
+		if (!n->state.compare_exchange_strong(expected, timer_node::fired, ::std::memory_order::acq_rel)) {
+			discard(n);
+			return;
+		}
+		task t = static_cast<task&&>(n->t);
+		// An embedded node can be destroyed as soon as its task is resumed, so it must not be touched after this
+		if (n->refs.load(::std::memory_order::relaxed))
+			n->release();
+		sink(static_cast<task&&>(t));
+	}
+
+	template<class F>
+	void insert_or_fire(timer_node* n, F& sink) noexcept {
+		if (n->state.load(::std::memory_order::acquire) == timer_node::cancelled)
+			discard(n);
+		else if (n->expiry <= now)
+			fire(n, sink);
+		else
+			insert(n);
+	}
+
+	public:
+	timer_wheel() noexcept : epoch{ clock::now() } {}
+
+	timer_wheel(const timer_wheel&) = delete;
+	timer_wheel& operator=(const timer_wheel&) = delete;
+
+	// Expiry ticks are rounded up, so that timers never fire early
+	::uint64_t to_tick(clock::time_point ts) const noexcept {
+		if (ts <= epoch)
+			return 0;
+		return ::uint64_t((ts - epoch + resolution - clock::duration{ 1 }) / resolution);
+	}
+
+	// Elapsed ticks are rounded down
+	::uint64_t elapsed(clock::time_point ts) const noexcept {
+		if (ts <= epoch)
+			return 0;
+		return ::uint64_t((ts - epoch) / resolution);
+	}
+
+	clock::time_point to_time_point(::uint64_t tick) const noexcept {
+		return epoch + tick * resolution;
+	}
+
+	// Any thread. The node must stay alive until it has fired or been discarded.
+	void schedule(timer_node* n, clock::time_point when, ::size_t shard_idx) noexcept {
+		n->expiry = to_tick(when);
+		push(inserts[shard_idx % n_shards].head, n, &timer_node::next);
+	}
+
+	// Any thread. Returns true if the timer was cancelled before it fired.
+	bool cancel(timer_node* n) noexcept {
+		::uint32_t expected = timer_node::pending;
+		if (!n->state.compare_exchange_strong(expected, timer_node::cancelled, ::std::memory_order::acq_rel))
+			return false;
+		n->refs.fetch_add(1, ::std::memory_order::relaxed);
+		push(cancels, n, &timer_node::cancel_next);
+		return true;
+	}
+
+	// Any thread. Moves every timer that has expired by ts into sink(task&&).
+	// Returns false without doing anything, if another thread is already processing the wheel.
+	template<class F>
+	bool process(clock::time_point ts, F&& sink) noexcept {
+		if (busy.exchange(true, ::std::memory_order::acquire))
+			return false;
+
+		for (shard& s : inserts) {
+			timer_node* n = s.head.exchange(nullptr, ::std::memory_order::acquire);
+			while (n) {
+				timer_node* next = n->next;
+				insert_or_fire(n, sink);
+				n = next;
+			}
+		}
+
+		timer_node* n = cancels.exchange(nullptr, ::std::memory_order::acquire);
+		while (n) {
+			timer_node* next = n->cancel_next;
+			// If the node isn't linked yet, it's still in an insertion buffer, and gets discarded when it's inserted
+			if (n->level != timer_node::unlinked) {
+				unlink(n);
+				discard(n);
+			}
+			n->release();
+			n = next;
+		}
+
+		advance(elapsed(ts), sink);
+
+		next_tick.store(earliest_deadline(), ::std::memory_order::relaxed);
+		busy.store(false, ::std::memory_order::release);
+		return true;
+	}
+
+	// When the next slot is due, as of the latest process() call. It can be earlier than any actual timer,
+	// if the slot only needs to be cascaded.
+	clock::time_point next_expiry() const noexcept {
+		const ::uint64_t tick = next_tick.load(::std::memory_order::relaxed);
+		return tick == UINT64_MAX ? clock::time_point::max() : to_time_point(tick);
+	}
+
+	// The rest is only for the thread that's processing the wheel, and public mainly for benchmarking
+
+	void insert(timer_node* n) noexcept {
+		assert(n->expiry > now);
+		// Timers beyond the range of the wheel are parked as far as it reaches, and re-inserted from there
+		const ::uint64_t placed = (n->expiry - now) < max_range ? n->expiry : now + max_range - 1;
+		const ::uint32_t level = level_for(now, placed);
+		const ::uint32_t slot = (placed >> (level * level_bits)) & (n_slots - 1);
+		timer_node*& head = slots[level][slot];
+		n->level = ::uint8_t(level);
+		n->slot  = ::uint8_t(slot);
+		n->prev = nullptr;
+		n->next = head;
+		if (head)
+			head->prev = n;
+		head = n;
+		occupied[level] |= 1ull << slot;
+	}
+
+	void unlink(timer_node* n) noexcept {
+		if (n->prev)
+			n->prev->next = n->next;
+		else
+			slots[n->level][n->slot] = n->next;
+		if (n->next)
+			n->next->prev = n->prev;
+		if (!slots[n->level][n->slot])
+			occupied[n->level] &= ~(1ull << n->slot);
+		n->level = timer_node::unlinked;
+		n->next = n->prev = nullptr;
+	}
+
+	// Fires every timer with expiry <= tick. Whole slots are detached at once, so expiry happens in batches.
+	template<class F>
+	void advance(::uint64_t tick, F& sink) noexcept {
+		for (;;) {
+			::uint32_t level = 0;
+			while (level != n_levels && !occupied[level])
+				++level;
+			if (level == n_levels)
+				break;
+			const ::uint64_t deadline = slot_deadline(level);
+			if (deadline > tick)
+				break;
+			now = deadline;
+
+			const ::uint32_t slot = (deadline >> (level * level_bits)) & (n_slots - 1);
+			timer_node* n = slots[level][slot];
+			slots[level][slot] = nullptr;
+			occupied[level] &= ~(1ull << slot);
+			while (n) {
+				timer_node* next = n->next;
+				n->level = timer_node::unlinked;
+				// Timers on higher levels get cascaded down, since now they're within range of a lower level
+				insert_or_fire(n, sink);
+				n = next;
+			}
+		}
+		if (tick > now)
+			now = tick;
+	}
+};
+
+} // namespace jpl::tp::detail
+
+#endif // JPL_BITS_THREAD_POOL_TIMER_WHEEL_HPP
@@ -0,0 +1,446 @@
+#ifndef JPL_BITS_THREAD_POOL_WHEN_ALL_HPP
+#define JPL_BITS_THREAD_POOL_WHEN_ALL_HPP
+
+#include <jpl/vector.hpp>
+#include <jpl/bits/trivially_relocatable.hpp>
+
+#include <atomic>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+
+// Expects <coroutine> (or the experimental one, aliased into std) to be included already, see thread_pool.hpp
+
+namespace jpl::tp {
+
+// Stands in for the results of awaitables that don't produce anything
+struct void_result {};
+
+template<class T>
+struct when_any_result {
+	::size_t index;
+	T value;
+};
+
+template<>
+struct when_any_result<void> {
+	::size_t index;
+};
+
+namespace detail {
+
+template<class A>
+decltype(auto) get_awaiter(A&& awaitable) {
+	if constexpr (requires { static_cast<A&&>(awaitable).operator co_await(); })
+		return static_cast<A&&>(awaitable).operator co_await();
+	else if constexpr (requires { operator co_await(static_cast<A&&>(awaitable)); })
+		return operator co_await(static_cast<A&&>(awaitable));
+	else
+		return static_cast<A&&>(awaitable);
+}
+
+// Rvalue references are stored as values, lvalue references as references
+template<class A>
+using await_value_t = ::std::conditional_t<
+	::std::is_rvalue_reference_v<decltype(get_awaiter(::std::declval<A>()).await_resume())>,
+	::std::remove_cvref_t<decltype(get_awaiter(::std::declval<A>()).await_resume())>,
+	decltype(get_awaiter(::std::declval<A>()).await_resume())
+>;
+
+template<class T>
+using result_or_void_result_t = ::std::conditional_t<::std::is_void_v<T>, void_result, T>;
+
+// Called by every child as it finishes. Returns the coroutine to resume next, which is either the awaiting
+// coroutine if this was the last child it was waiting for, or noop_coroutine.
+using arrive_fn = ::std::coroutine_handle<>(*)(void* ctx, ::size_t index) noexcept;
+
+template<class T>
+struct when_child_promise_base {
+	arrive_fn arrive;
+	void* ctx;
+	::size_t index;
+	::std::exception_ptr exception;
+
+	struct final_awaiter {
+		static constexpr bool await_ready() noexcept { return false; }
+		template<class P>
+		::std::coroutine_handle<> await_suspend(::std::coroutine_handle<P> handle) noexcept {
+			// This frame may be destroyed by the call, so nothing can be read from it afterwards
+			when_child_promise_base& promise = handle.promise();
+			return promise.arrive(promise.ctx, promise.index);
+		}
+		static constexpr void await_resume() noexcept {}
+	};
+
+	static constexpr ::std::suspend_always initial_suspend() noexcept { return {}; }
+	static constexpr final_awaiter final_suspend() noexcept { return {}; }
+
+	void unhandled_exception() noexcept {
+		exception = ::std::current_exception();
+	}
+};
+
+template<class T>
+class when_child;
+
+template<class T>
+struct when_child_promise : when_child_promise_base<T> {
+	using stored_t = ::std::conditional_t<::std::is_reference_v<T>, ::std::remove_reference_t<T>*, T>;
+	union { stored_t value; };
+	bool has_value{ false };
+
+	when_child_promise() noexcept {}
+	~when_child_promise() {
+		if (has_value)
+			value.~stored_t();
+	}
+
+	when_child<T> get_return_object() noexcept;
+
+	template<class U>
+	void return_value(U&& val) {
+		if constexpr (::std::is_reference_v<T>)
+			::new (&value) stored_t{ &val };
+		else
+			::new (&value) stored_t(static_cast<U&&>(val));
+		has_value = true;
+	}
+
+	T result() {
+		if (this->exception)
+			::std::rethrow_exception(this->exception);
+		if constexpr (::std::is_reference_v<T>)
+			return *value;
+		else
+			return static_cast<T&&>(value);
+	}
+};
+
+template<>
+struct when_child_promise<void> : when_child_promise_base<void> {
+	when_child<void> get_return_object() noexcept;
+	static constexpr void return_void() noexcept {}
+	void result() {
+		if (exception)
+			::std::rethrow_exception(exception);
+	}
+};
+
+// Coroutine that awaits one of the combinator's awaitables, and reports back to the combinator when it's done
+template<class T>
+class when_child {
+	public:
+	using promise_type = when_child_promise<T>;
+	using result_type  = T;
+
+	private:
+	::std::coroutine_handle<promise_type> handle;
+
+	public:
+	explicit when_child(::std::coroutine_handle<promise_type> handle) noexcept : handle{ handle } {}
+	when_child(when_child&& other) noexcept : handle{ other.handle } {
+		other.handle = nullptr;
+	}
+	when_child& operator=(when_child&& other) noexcept {
+		::std::coroutine_handle<promise_type> temp = handle;
+		handle = other.handle;
+		other.handle = temp;
+		return *this;
+	}
+	~when_child() noexcept {
+		if (handle) handle.destroy();
+	}
+
+	void start(arrive_fn arrive, void* ctx, ::size_t index) noexcept {
+		promise_type& promise = handle.promise();
+		promise.arrive = arrive;
+		promise.ctx = ctx;
+		promise.index = index;
+		handle.resume();
+	}
+
+	decltype(auto) result() {
+		return handle.promise().result();
+	}
+
+	result_or_void_result_t<T> result_or_void_result() {
+		if constexpr (::std::is_void_v<T>) {
+			result();
+			return {};
+		} else {
+			return result();
+		}
+	}
+};
+
+template<class T>
+inline when_child<T> when_child_promise<T>::get_return_object() noexcept {
+	return when_child<T>{ ::std::coroutine_handle<when_child_promise<T>>::from_promise(*this) };
+}
+
+inline when_child<void> when_child_promise<void>::get_return_object() noexcept {
+	return when_child<void>{ ::std::coroutine_handle<when_child_promise<void>>::from_promise(*this) };
+}
+
+// A is a reference for lvalue awaitables, so those are awaited in place, and rvalues are moved into the frame
+template<class A>
+when_child<await_value_t<A>> make_when_child(A awaitable) {
+	if constexpr (::std::is_void_v<await_value_t<A>>)
+		co_await static_cast<A&&>(awaitable);
+	else
+		co_return co_await static_cast<A&&>(awaitable);
+}
+
+// Every child decrements the counter once. The awaiting coroutine holds one extra count while it's starting the
+// children, so that children finishing synchronously can't resume it before it has actually suspended.
+struct when_all_counter {
+	::std::atomic<::size_t> count;
+	::std::coroutine_handle<> awaiting;
+
+	static ::std::coroutine_handle<> arrive(void* ctx, ::size_t) noexcept {
+		when_all_counter& self = *static_cast<when_all_counter*>(ctx);
+		if (self.count.fetch_sub(1, ::std::memory_order::acq_rel) == 1)
+			return self.awaiting;
+		return ::std::noop_coroutine();
+	}
+
+	// Returns true if the awaiting coroutine has to suspend, and false if every child has already finished
+	bool release_start_count() noexcept {
+		return count.fetch_sub(1, ::std::memory_order::acq_rel) != 1;
+	}
+};
+
+template<class ... Ts>
+class when_all_awaitable {
+	when_all_counter counter;
+	::std::tuple<when_child<Ts>...> children;
+
+	public:
+	explicit when_all_awaitable(when_child<Ts>&& ... children) noexcept
+		: children{ static_cast<when_child<Ts>&&>(children)... }
+	{}
+
+	static constexpr bool await_ready() noexcept { return sizeof...(Ts) == 0; }
+
+	bool await_suspend(::std::coroutine_handle<> handle) noexcept {
+		counter.awaiting = handle;
+		counter.count.store(sizeof...(Ts) + 1, ::std::memory_order::relaxed);
+		::size_t index = 0;
+		::std::apply([&](auto& ... child) {
+			(child.start(&when_all_counter::arrive, &counter, index++), ...);
+		}, children);
+		return counter.release_start_count();
+	}
+
+	// If any child threw, the first one's exception is rethrown
+	::std::tuple<result_or_void_result_t<Ts>...> await_resume() {
+		return ::std::apply([](auto& ... child) {
+			return ::std::tuple<result_or_void_result_t<Ts>...>{ child.result_or_void_result()... };
+		}, children);
+	}
+};
+
+template<class T>
+class when_all_range_awaitable {
+	when_all_counter counter;
+	::jpl::vector<when_child<T>> children;
+
+	public:
+	explicit when_all_range_awaitable(::jpl::vector<when_child<T>>&& children) noexcept
+		: children{ static_cast<::jpl::vector<when_child<T>>&&>(children) }
+	{}
+
+	bool await_ready() const noexcept { return children.empty(); }
+
+	bool await_suspend(::std::coroutine_handle<> handle) noexcept {
+		counter.awaiting = handle;
+		counter.count.store(children.size() + 1, ::std::memory_order::relaxed);
+		for (::size_t i = 0; i != children.size(); ++i)
+			children[i].start(&when_all_counter::arrive, &counter, i);
+		return counter.release_start_count();
+	}
+
+	auto await_resume() {
+		if constexpr (::std::is_void_v<T>) {
+			for (when_child<T>& child : children)
+				child.result();
+		} else {
+			::jpl::vector<T> results;
+			results.reserve(children.size());
+			for (when_child<T>& child : children)
+				results.emplace_back(child.result());
+			return results;
+		}
+	}
+};
+
+// Unlike when_all, the awaiting coroutine is resumed while the other children may still be running, so the state
+// lives on the heap, and whoever is done with it last frees it.
+template<class T>
+struct when_any_state {
+	::jpl::vector<when_child<T>> children;
+	::std::coroutine_handle<> awaiting;
+	::size_t winner;
+	::std::atomic<bool> decided{ false };
+	// The winner and the awaiting coroutine (when it has started every child) both decrement this,
+	// and the second one resumes the awaiting coroutine
+	::std::atomic<::uint32_t> resume_count{ 2 };
+	// One reference per child, plus one for the awaiting coroutine
+	::std::atomic<::size_t> refs;
+
+	void release(::size_t n = 1) noexcept {
+		if (refs.fetch_sub(n, ::std::memory_order::acq_rel) == n)
+			delete this;
+	}
+
+	static ::std::coroutine_handle<> arrive(void* ctx, ::size_t index) noexcept {
+		when_any_state& self = *static_cast<when_any_state*>(ctx);
+		::std::coroutine_handle<> next = ::std::noop_coroutine();
+		if (!self.decided.exchange(true, ::std::memory_order::acq_rel)) {
+			self.winner = index;
+			if (self.resume_count.fetch_sub(1, ::std::memory_order::acq_rel) == 1)
+				next = self.awaiting;
+		}
+		self.release();
+		return next;
+	}
+};
+
+template<class T>
+class when_any_awaitable {
+	when_any_state<T>* state;
+
+	public:
+	explicit when_any_awaitable(::jpl::vector<when_child<T>>&& children)
+		: state{ new when_any_state<T>{ static_cast<::jpl::vector<when_child<T>>&&>(children) } }
+	{
+		state->refs.store(state->children.size() + 1, ::std::memory_order::relaxed);
+	}
+	when_any_awaitable(when_any_awaitable&& other) noexcept : state{ other.state } {
+		other.state = nullptr;
+	}
+	~when_any_awaitable() noexcept {
+		if (state) state->release();
+	}
+
+	when_any_awaitable(const when_any_awaitable&) = delete;
+	when_any_awaitable& operator=(const when_any_awaitable&) = delete;
+
+	bool await_ready() const noexcept {
+		// Nothing to wait for, which await_resume reports as an error
+		return state->children.empty();
+	}
+
+	bool await_suspend(::std::coroutine_handle<> handle) noexcept {
+		when_any_state<T>& s = *state;
+		s.awaiting = handle;
+		const ::size_t n = s.children.size();
+		::size_t i = 0;
+		// Children that haven't been started by the time a winner is decided are never started at all
+		for (; i != n && !s.decided.load(::std::memory_order::acquire); ++i)
+			s.children[i].start(&when_any_state<T>::arrive, &s, i);
+		if (i != n)
+			s.release(n - i);
+		return s.resume_count.fetch_sub(1, ::std::memory_order::acq_rel) != 1;
+	}
+
+	// The winner's result, or its exception. The results and exceptions of the others are discarded.
+	when_any_result<T> await_resume() {
+		if (state->children.empty()) [[unlikely]]
+			throw ::std::invalid_argument{ "jpl::tp::when_any: nothing to wait for" };
+		when_child<T>& child = state->children[state->winner];
+		if constexpr (::std::is_void_v<T>) {
+			child.result();
+			return { state->winner };
+		} else {
+			return { state->winner, child.result() };
+		}
+	}
+};
+
+template<class R>
+auto make_when_children(R&& range) {
+	using awaitable_t = decltype(*range.begin());
+	using value_t = await_value_t<::std::conditional_t<::std::is_lvalue_reference_v<R>, awaitable_t, ::std::remove_reference_t<awaitable_t>&&>>;
+	::jpl::vector<when_child<value_t>> children;
+	for (auto&& awaitable : range) {
+		if constexpr (::std::is_lvalue_reference_v<R>)
+			children.emplace_back(make_when_child<awaitable_t>(awaitable));
+		else
+			children.emplace_back(make_when_child<::std::remove_reference_t<awaitable_t>>(static_cast<::std::remove_reference_t<awaitable_t>&&>(awaitable)));
+	}
+	return children;
+}
+
+template<class R>
+concept awaitable_range = requires(R&& range) {
+	range.begin();
+	range.end();
+	{ get_awaiter(*range.begin()).await_ready() };
+};
+
+} // namespace detail
+
+// co_await when_all(a, b, c) starts every awaitable and resumes when all of them are done, with a tuple of their
+// results (void_result for awaitables that don't produce anything).
+//
+// The children are started in order on the awaiting thread, and each runs until its first suspension, so for
+// example IO requests are all submitted before any of them is waited for. CPU bound children run one after the other
+// unless they yield to the pool first. Each finishing child costs a single atomic decrement, and the last one
+// resumes the awaiting coroutine directly on its own thread.
+//
+// Lvalue awaitables are awaited in place, and must outlive the co_await. Rvalues are moved into the combinator.
+template<class ... As>
+[[nodiscard]] auto when_all(As&& ... awaitables) {
+	return detail::when_all_awaitable<detail::await_value_t<As>...>{
+		detail::make_when_child<As>(static_cast<As&&>(awaitables))...
+	};
+}
+
+// Like the variadic one, but for a range of awaitables with the same result type. Results come back in a
+// jpl::vector, in the same order as the range. Awaitables are moved out of the range, unless it's an lvalue.
+template<class R> requires detail::awaitable_range<R>
+[[nodiscard]] auto when_all(R&& range) {
+	auto children = detail::make_when_children(static_cast<R&&>(range));
+	using value_t = typename decltype(children)::value_type::result_type;
+	return detail::when_all_range_awaitable<value_t>{ static_cast<decltype(children)&&>(children) };
+}
+
+// Resumes as soon as the first awaitable finishes, with its index and result. The rest keep running in the
+// background until they're done, and their results are discarded. Awaitables that haven't been started by the time
+// the first one finishes are never started.
+//
+// Unlike with when_all, the co_await returning doesn't mean the awaitables are done with. Awaitables of an lvalue
+// range are awaited in place, so the range has to outlive every child, not just the co_await, which is easiest to get
+// by passing an rvalue range and letting the combinator own them. The same goes for anything the children refer to.
+template<class R> requires detail::awaitable_range<R>
+[[nodiscard]] auto when_any(R&& range) {
+	auto children = detail::make_when_children(static_cast<R&&>(range));
+	using value_t = typename decltype(children)::value_type::result_type;
+	return detail::when_any_awaitable<value_t>{ static_cast<decltype(children)&&>(children) };
+}
+
+template<class A, class ... As>
+	requires (!detail::awaitable_range<A> && (::std::is_same_v<detail::await_value_t<A>, detail::await_value_t<As>> && ...))
+[[nodiscard]] auto when_any(A&& first, As&& ... rest) {
+	using value_t = detail::await_value_t<A>;
+	::jpl::vector<detail::when_child<value_t>> children;
+	children.reserve(1 + sizeof...(As));
+	children.emplace_back(detail::make_when_child<A>(static_cast<A&&>(first)));
+	(children.emplace_back(detail::make_when_child<As>(static_cast<As&&>(rest))), ...);
+	return detail::when_any_awaitable<value_t>{ static_cast<::jpl::vector<detail::when_child<value_t>>&&>(children) };
+}
+
+} // namespace jpl::tp
+
+namespace jpl {
+
+// Just a coroutine handle
+template<class T>
+inline constexpr bool trivially_relocatable<tp::detail::when_child<T>> = true;
+
+} // namespace jpl
+
+#endif // JPL_BITS_THREAD_POOL_WHEN_ALL_HPP
@@ -0,0 +1,216 @@
+#ifndef JPL_BITS_TOPOLOGY_HPP
+#define JPL_BITS_TOPOLOGY_HPP
+
+#include <jpl/vector.hpp>
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace jpl::detail {
+
+inline constexpr ::size_t page_size{ 4096 };
+inline constexpr ::uint32_t no_node{ UINT32_MAX };
+
+// CPUs the process is allowed to run on, grouped by NUMA node.
+// Node indices are dense, so they don't necessarily match the kernel's node ids, which can have gaps.
+struct topology {
+	::jpl::vector<::uint32_t> cpu_node; // Node index of each CPU id, no_node if the CPU isn't usable
+	::jpl::vector<::uint32_t> node_ids; // Kernel node id of each node index
+	::uint32_t n_nodes{ 1 };
+
+	// Usable CPUs of the node, in ascending order
+	::jpl::vector<::uint32_t> cpus_of(::uint32_t node) const {
+		::jpl::vector<::uint32_t> cpus;
+		for (::uint32_t cpu = 0; cpu != cpu_node.size(); ++cpu)
+			if (cpu_node[cpu] == node)
+				cpus.push_back(cpu);
+		return cpus;
+	}
+};
+
+#ifdef __linux__
+
+// Small sysfs files only, so a single read is enough. Returns false if the file doesn't exist.
+inline bool read_sysfs(const char* path, char (&buffer)[4096]) noexcept {
+	const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	const ::ssize_t n = ::read(fd, buffer, sizeof(buffer) - 1);
+	::close(fd);
+	buffer[n > 0 ? n : 0] = '\0';
+	return n > 0;
+}
+
+// Calls f(id) for every id in a kernel list format string, like "0-3,8,10-11"
+template<class F>
+void parse_id_list(const char* str, F&& f) {
+	while (*str >= '0' && *str <= '9') {
+		::uint32_t first = 0;
+		while (*str >= '0' && *str <= '9')
+			first = first * 10 + ::uint32_t(*str++ - '0');
+		::uint32_t last = first;
+		if (*str == '-') {
+			++str;
+			last = 0;
+			while (*str >= '0' && *str <= '9')
+				last = last * 10 + ::uint32_t(*str++ - '0');
+		}
+		for (::uint32_t id = first; id <= last; ++id)
+			f(id);
+		if (*str == ',')
+			++str;
+	}
+}
+
+// Falls back to a single node with every allowed CPU, if sysfs doesn't have NUMA information (or isn't mounted)
+inline topology read_topology() {
+	topology topo;
+	::cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		for (::uint32_t cpu = 0; cpu != ::std::thread::hardware_concurrency(); ++cpu)
+			CPU_SET(cpu, &allowed);
+	}
+	topo.cpu_node.resize(::uint32_t(CPU_SETSIZE), no_node);
+
+	char buffer[4096];
+	::uint32_t n_nodes = 0;
+	if (read_sysfs("/sys/devices/system/node/online", buffer)) {
+		::jpl::vector<::uint32_t> online;
+		parse_id_list(buffer, [&](::uint32_t id) { online.push_back(id); });
+		for (::uint32_t id : online) {
+			char path[64];
+			::snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", id);
+			if (!read_sysfs(path, buffer))
+				continue;
+			bool has_cpus = false;
+			parse_id_list(buffer, [&](::uint32_t cpu) {
+				if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+					topo.cpu_node[cpu] = n_nodes;
+					has_cpus = true;
+				}
+			});
+			// Memory-only nodes, and nodes whose CPUs are all outside of our affinity mask are skipped
+			if (has_cpus) {
+				topo.node_ids.push_back(id);
+				++n_nodes;
+			}
+		}
+	}
+
+	if (n_nodes == 0) {
+		for (::uint32_t cpu = 0; cpu != CPU_SETSIZE; ++cpu)
+			topo.cpu_node[cpu] = CPU_ISSET(cpu, &allowed) ? 0 : no_node;
+		topo.node_ids.push_back(0);
+		n_nodes = 1;
+	}
+	topo.n_nodes = n_nodes;
+	return topo;
+}
+
+// Best effort: sets the preferred node of the pages in [ptr, ptr + size), and migrates the ones that already exist.
+// ptr must be page aligned. Failures are ignored, since the memory is still perfectly usable, just possibly remote.
+inline void bind_to_node(void* ptr, ::size_t size, ::uint32_t node_id) noexcept {
+	constexpr ::size_t mask_bits = sizeof(unsigned long) * CHAR_BIT;
+	unsigned long mask[1024 / mask_bits]{};
+	if (node_id >= 1024)
+		return;
+	mask[node_id / mask_bits] = 1ul << (node_id % mask_bits);
+	::syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, mask, sizeof(mask) * CHAR_BIT + 1, MPOL_MF_MOVE);
+}
+
+// Page aligned memory, preferably on the given kernel node
+inline void* alloc_on_node(::size_t size, ::uint32_t node_id) {
+	void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+		throw ::std::bad_alloc{};
+	// The pages aren't touched yet, so they'll be faulted in on the preferred node
+	bind_to_node(ptr, size, node_id);
+	return ptr;
+}
+
+inline void free_on_node(void* ptr, ::size_t size) noexcept {
+	::munmap(ptr, size);
+}
+
+// An empty CPU list leaves the thread's affinity alone
+inline void set_affinity(::std::thread& thread, const ::jpl::vector<::uint32_t>& cpus) noexcept {
+	if (cpus.empty())
+		return;
+	::cpu_set_t set;
+	CPU_ZERO(&set);
+	for (::uint32_t cpu : cpus)
+		if (cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &set);
+	::pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+inline ::uint32_t current_cpu() noexcept {
+	const int cpu = ::sched_getcpu();
+	return cpu < 0 ? 0 : ::uint32_t(cpu);
+}
+
+#else
+
+// TODO: topology detection and pinning on other platforms. Until then everything is a single node, and nothing is pinned.
+inline topology read_topology() {
+	topology topo;
+	topo.cpu_node.resize(::std::thread::hardware_concurrency(), 0);
+	topo.node_ids.push_back(0);
+	return topo;
+}
+
+inline void bind_to_node(void*, ::size_t, ::uint32_t) noexcept {}
+
+inline void* alloc_on_node(::size_t size, ::uint32_t) {
+	return ::operator new(size, ::std::align_val_t{ page_size });
+}
+
+inline void free_on_node(void* ptr, ::size_t) noexcept {
+	::operator delete(ptr, ::std::align_val_t{ page_size });
+}
+
+inline void set_affinity(::std::thread&, const ::jpl::vector<::uint32_t>&) noexcept {}
+
+inline ::uint32_t current_cpu() noexcept {
+	return 0;
+}
+
+#endif
+
+template<class T>
+T* new_on_node(::uint32_t node_id) {
+	static_assert(alignof(T) <= page_size);
+	void* ptr = alloc_on_node(sizeof(T), node_id);
+	try {
+		return ::new (ptr) T{};
+	} catch (...) {
+		free_on_node(ptr, sizeof(T));
+		throw;
+	}
+}
+
+template<class T>
+void delete_on_node(T* ptr) noexcept {
+	if (!ptr)
+		return;
+	ptr->~T();
+	free_on_node(ptr, sizeof(T));
+}
+
+} // namespace jpl::detail
+
+#endif // JPL_BITS_TOPOLOGY_HPP
@@ -3,43 +3,89 @@
 
 #include <atomic>
 #include <bit>
+#include <chrono>
 #include <climits>
+#if __has_include(<coroutine>)
+#include <coroutine>
+#elif __has_include(<experimental/coroutine>)
+#include <experimental/coroutine>
+namespace std { using namespace experimental; }
+#else
+#error "requires C++20 coroutines"
+#endif
 #include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
 #include <new>
 #include <optional>
+#include <stdexcept>
 #include <type_traits>
 
-#ifdef __linux__
-#include <linux/futex.h>
-#include <sys/syscall.h>
-#include <unistd.h>
-#elif defined(_MSC_VER)
-#define WIN32_LEAN_AND_MEAN
-#include "windows.h"
-#include "synchapi.h"
-#else
-#error "jpl::concurrent_queue is only supported on Linux and Windows"
-#endif
+#include <jpl/bits/allocator.hpp>
+#include <jpl/bits/cache_line.hpp>
+#include <jpl/bits/cpu_relax.hpp>
+#include <jpl/bits/eventcount.hpp>
+#include <jpl/bits/futex.hpp>
 
 namespace jpl {
 
-#ifdef __cpp_lib_hardware_interference_size
-	using ::std::hardware_destructive_interference_size;
-#elif defined(JPL_CACHE_LINE_SIZE)
-	inline constexpr ::size_t hardware_destructive_interference_size{ JPL_CACHE_LINE_SIZE };
-#else
-	inline constexpr ::size_t hardware_destructive_interference_size{ 64 };
-#endif
+// Pass as ring_buffer_size to give the capacity to the constructor instead, in which case the ring buffer is allocated
+// with Alloc. For big rings, ::jpl::huge_page_allocator backs it with transparent huge pages.
+inline constexpr ::uint32_t dynamic_size{ 0 };
+
+// How blocked threads sleep
+enum class queue_wait : ::uint8_t {
+	// Each thread sleeps on the slot of the turn it took, and whoever fills or empties a slot wakes everyone on it.
+	// Blocked threads are served in turn order.
+	per_slot,
+	// Blocking pop and push spin for a bit, and then sleep on one of two shared eventcounts, one for consumers and one
+	// for producers. They only take a turn once its slot is ready, so any thread can take any element, and every
+	// push or pop wakes at most one sleeper, and makes no syscall at all when nobody sleeps. A woken thread wakes the
+	// next one if there's more to take, which covers wakes spent on elements that were published out of turn order.
+	// Blocked threads are served in no particular order.
+	eventcount,
+};
+
+// Collected by queues with with_stats
+struct queue_stats {
+	::uint32_t max_size;                  // Most elements seen in the queue at once, sampled after every push
+	::uint64_t blocked_pushes;            // Pushes that had to wait for room
+	::uint64_t blocked_pops;              // Pops that had to wait for an element
+	::uint64_t futex_waits;               // Times any of them went to sleep
+	::std::chrono::nanoseconds wait_time; // Time they spent waiting in total
+};
+
+namespace detail {
+
+// Small number for every thread, for spreading per-thread counters
+inline ::uint32_t thread_stripe() noexcept {
+	static ::std::atomic<::uint32_t> next{ 0 };
+	thread_local const ::uint32_t index{ next.fetch_add(1, ::std::memory_order::relaxed) };
+	return index;
+}
+
+} // namespace detail
+
+namespace tp::detail {
+// Queues a coroutine on the thread pool. Defined by jpl/thread_pool.hpp, which has to be included for async_pop and
+// async_push.
+void resume_on_pool(::std::coroutine_handle<> handle) noexcept;
+} // namespace tp::detail
 
 template<class T, ::uint32_t ring_buffer_size, bool use_optional = true
 #ifdef JPL_CONCURRENT_QUEUE_TEST_OFFSET
 	, ::uint32_t offset = 0
 #endif
+	, queue_wait waiting = queue_wait::per_slot
+	, bool with_stats = false
+	, bool with_awaiters = false
+	, template<class> class Alloc = ::jpl::default_allocator
 >
 	requires(
 		// buffer size must be a power of 2, because it guarantees that the indices are continuous when counters overflow
 		// it also allows the compiler to optimize modulo operations into bitwise ANDs
-		(::std::popcount(ring_buffer_size) == 1)
+		(ring_buffer_size == dynamic_size || ::std::popcount(ring_buffer_size) == 1)
 		// To ensure integrity of the queue, all operations must be noexcept, which means that the stored type must be
 		// noexcept movable and destructible.
 		&& ::std::is_nothrow_move_constructible_v<T>
@@ -63,168 +109,780 @@ class concurrent_queue {
 
 	using optional_t = std::conditional_t<use_optional, ::std::optional<T>, T>;
 
+	static constexpr bool is_dynamic{ ring_buffer_size == dynamic_size };
+	static_assert(!is_dynamic || ::jpl::allocator<Alloc<node>>);
+
+	static constexpr ::uint32_t per_cache_line = hardware_destructive_interference_size / alignof(node);
+	static constexpr ::uint32_t repeat_after = 8 < per_cache_line ? 8 : per_cache_line;
+	static constexpr ::uint32_t shuffle_period = per_cache_line * repeat_after;
+
 	// Shuffle indices when accessing ring buffer to avoid false sharing, while still trying to benefit from true sharing.
 	[[gnu::always_inline]] static constexpr ::uint32_t shuffle_idx(::uint32_t idx) noexcept {
-		constexpr ::uint32_t per_cache_line = hardware_destructive_interference_size / alignof(node);
-		constexpr ::uint32_t repeat_after = 8 < per_cache_line ? 8 : per_cache_line;
-		constexpr ::uint32_t period = per_cache_line * repeat_after;
 		// assuming for example per_cache_line = 16 and repeat_after = 2, this will lead to a pattern like
 		// 0, 16, 1, 17, 2, 18, 3, 19, etc.
 		// eventually it will go for example from 31 to 32, but those should be on different cache lines, because
 		// the ring buffer is aligned to hardware_destructive_interference_size, and the period is a multiple of cache line size
-		if constexpr (per_cache_line < 2)
+		// Rings smaller than a period aren't shuffled, since the pattern would run past their end
+		if constexpr (per_cache_line < 2 || (!is_dynamic && ring_buffer_size < shuffle_period))
 			return idx;
 		else
-			return (idx / period * period) + ((idx / repeat_after) % per_cache_line) + ((idx % repeat_after) * per_cache_line);
+			return (idx / shuffle_period * shuffle_period) + ((idx / repeat_after) % per_cache_line) + ((idx % repeat_after) * per_cache_line);
 	}
 
-	alignas(hardware_destructive_interference_size) node buffer[ring_buffer_size];
+	// With dynamic_size, the buffer is allocated with room for aligning it to a cache line
+	struct heap_buffer {
+		node* allocation;
+		::uint32_t size;
+		::uint32_t n_allocated;
+	};
+	struct no_heap_buffer {};
+
+	alignas(hardware_destructive_interference_size) ::std::conditional_t<is_dynamic, node*, node[is_dynamic ? 1 : ring_buffer_size]> buffer;
+	[[no_unique_address]] ::std::conditional_t<is_dynamic, heap_buffer, no_heap_buffer> heap;
 	alignas(hardware_destructive_interference_size) ::std::atomic<::uint32_t> head{ offset };
 	alignas(hardware_destructive_interference_size) ::std::atomic<::uint32_t> tail{ offset };
 
+	static constexpr bool use_eventcount{ waiting == queue_wait::eventcount };
+	// Tries before a blocking operation sleeps on an eventcount
+	static constexpr ::uint32_t n_spins{ 64 };
+
+	struct eventcounts {
+		::jpl::detail::eventcount not_empty;
+		::jpl::detail::eventcount not_full;
+	};
+	struct no_eventcounts {};
+	[[no_unique_address]] ::std::conditional_t<use_eventcount, eventcounts, no_eventcounts> events;
+
+	// With with_stats, threads count into one of n_stat_stripes sets of counters, picked by their thread_stripe(), and
+	// stats() adds them up. Besides the blocking paths, only push touches them, to sample the size.
+	static constexpr ::uint32_t n_stat_stripes{ 16 };
+
+	struct alignas(hardware_destructive_interference_size) stat_stripe {
+		::std::atomic<::uint64_t> blocked_pushes{ 0 };
+		::std::atomic<::uint64_t> blocked_pops{ 0 };
+		::std::atomic<::uint64_t> futex_waits{ 0 };
+		::std::atomic<::uint64_t> wait_ns{ 0 };
+		::std::atomic<::uint32_t> max_size{ 0 };
+	};
+	struct stat_stripes {
+		stat_stripe stripes[n_stat_stripes];
+	};
+	struct no_stat_stripes {};
+	[[no_unique_address]] ::std::conditional_t<with_stats, stat_stripes, no_stat_stripes> counters;
+
+	stat_stripe& my_stripe() noexcept requires(with_stats) {
+		return counters.stripes[::jpl::detail::thread_stripe() % n_stat_stripes];
+	}
+
+	// Counts one blocking push or pop, and the time from begin() until it goes out of scope, unless begin() was never
+	// called. Without with_stats, it's empty.
+	class block_stats {
+		concurrent_queue& queue;
+		::std::atomic<::uint64_t> stat_stripe::* counter;
+		::std::chrono::steady_clock::time_point start{};
+		bool started{ false };
+
+		public:
+		block_stats(concurrent_queue& queue, ::std::atomic<::uint64_t> stat_stripe::* counter) noexcept
+			: queue{ queue }, counter{ counter } {}
+		~block_stats() {
+			if constexpr (with_stats) {
+				if (!started)
+					return;
+				const auto waited = ::std::chrono::duration_cast<::std::chrono::nanoseconds>(::std::chrono::steady_clock::now() - start);
+				stat_stripe& stripe = queue.my_stripe();
+				(stripe.*counter).fetch_add(1, ::std::memory_order::relaxed);
+				stripe.wait_ns.fetch_add(::uint64_t(waited.count()), ::std::memory_order::relaxed);
+			}
+		}
+		block_stats(const block_stats&) = delete;
+		block_stats& operator=(const block_stats&) = delete;
+
+		void begin() noexcept {
+			if constexpr (with_stats) {
+				if (!started) {
+					started = true;
+					start = ::std::chrono::steady_clock::now();
+				}
+			}
+		}
+	};
+
+	[[gnu::always_inline]] void count_futex_wait() noexcept {
+		if constexpr (with_stats)
+			my_stripe().futex_waits.fetch_add(1, ::std::memory_order::relaxed);
+	}
+
+	// end_turn is one past the turn that was just pushed
+	[[gnu::always_inline]] void sample_size(::uint32_t end_turn) noexcept {
+		if constexpr (with_stats) {
+			// Consumers may have gotten past end_turn already
+			const ::int32_t size = ::int32_t(end_turn - head.load(::std::memory_order::relaxed));
+			if (size <= 0)
+				return;
+			::std::atomic<::uint32_t>& max_size = my_stripe().max_size;
+			::uint32_t seen = max_size.load(::std::memory_order::relaxed);
+			while (::uint32_t(size) > seen && !max_size.compare_exchange_weak(seen, ::uint32_t(size), ::std::memory_order::relaxed));
+		}
+	}
+
 	public:
-	concurrent_queue() noexcept {
-		for (::uint32_t i = 0; i != ring_buffer_size; ++i) {
+	class pop_awaiter;
+	class push_awaiter;
+
+	private:
+	// With with_awaiters, coroutines suspended in async_pop and async_push, in FIFO lists. Whatever publishes an
+	// element or frees a slot checks n_parked after its seq_cst store to the slot's state, and parking increments it
+	// before trying the queue once more, so either the parked coroutine sees that store, or the other thread sees it
+	// and serves it. Without with_awaiters, it's empty, and nothing checks it.
+	struct alignas(hardware_destructive_interference_size) parked_coroutines {
+		::std::atomic<::uint32_t> n_parked{ 0 };
+		::std::mutex mutex;
+		pop_awaiter* pops{ nullptr };
+		pop_awaiter** pops_end{ &pops };
+		push_awaiter* pushes{ nullptr };
+		push_awaiter** pushes_end{ &pushes };
+	};
+	struct no_parked_coroutines {};
+	[[no_unique_address]] ::std::conditional_t<with_awaiters, parked_coroutines, no_parked_coroutines> parked;
+
+	[[gnu::always_inline]] ::uint32_t mask() const noexcept {
+		return capacity() - 1;
+	}
+
+	void init_states() noexcept {
+		for (::uint32_t i = 0; i != capacity(); ++i) {
 			if constexpr (offset)
-				buffer[shuffle_idx((i + offset) % ring_buffer_size)].state.store(i + offset, ::std::memory_order::relaxed);
+				buffer[shuffle_idx((i + offset) & mask())].state.store(i + offset, ::std::memory_order::relaxed);
 			else
 				buffer[shuffle_idx(i)].state.store(i, ::std::memory_order::relaxed);
 		}
 	}
+
+	public:
+	concurrent_queue() noexcept requires(!is_dynamic) {
+		init_states();
+	}
+	// Capacity is rounded up to a power of 2, and to at least one period of the index shuffling.
+	// Throws std::length_error if it's over 2^31, or whatever the allocator throws.
+	explicit concurrent_queue(::uint32_t capacity) requires(is_dynamic) {
+		if (capacity > (1u << 31))
+			throw ::std::length_error{ "jpl::concurrent_queue capacity over 2^31" };
+		const ::uint32_t size = ::std::bit_ceil(capacity < shuffle_period ? shuffle_period : capacity);
+		const ::uint32_t extra = ::uint32_t((hardware_destructive_interference_size + sizeof(node) - 1) / sizeof(node));
+		node* allocation = Alloc<node>{}.allocate(size + extra);
+		const ::uintptr_t aligned = (reinterpret_cast<::uintptr_t>(allocation) + hardware_destructive_interference_size - 1)
+			& ~::uintptr_t(hardware_destructive_interference_size - 1);
+		buffer = reinterpret_cast<node*>(aligned);
+		heap = { allocation, size, size + extra };
+		for (::uint32_t i = 0; i != size; ++i)
+			::new (&buffer[i]) node{};
+		init_states();
+	}
 	~concurrent_queue() noexcept {
 		while (head != tail) [[unlikely]] {
-			::uint32_t idx = shuffle_idx(head++ % ring_buffer_size);
+			::uint32_t idx = shuffle_idx(head++ & mask());
 			(buffer[idx].storage.val).~T();
 		}
+		if constexpr (is_dynamic) {
+			for (::uint32_t i = 0; i != heap.size; ++i)
+				buffer[i].~node();
+			Alloc<node>{}.deallocate(heap.allocation, heap.n_allocated);
+		}
 	};
 
+	// Number of slots in the ring buffer
+	[[nodiscard]] ::uint32_t capacity() const noexcept {
+		if constexpr (is_dynamic)
+			return heap.size;
+		else
+			return ring_buffer_size;
+	}
+
+	// Whether there's no element ready at the front, so that try_pop would fail. Only a snapshot if the queue is in use.
+	[[nodiscard]] bool empty() const noexcept {
+		return !front_ready();
+	}
+
+	// Sums up the counters of every thread. Meant for monitoring, so it's not a consistent snapshot if the queue is
+	// in use.
+	[[nodiscard]] queue_stats stats() const noexcept requires(with_stats) {
+		queue_stats out{};
+		for (const stat_stripe& stripe : counters.stripes) {
+			const ::uint32_t max_size = stripe.max_size.load(::std::memory_order::relaxed);
+			out.max_size = max_size > out.max_size ? max_size : out.max_size;
+			out.blocked_pushes += stripe.blocked_pushes.load(::std::memory_order::relaxed);
+			out.blocked_pops += stripe.blocked_pops.load(::std::memory_order::relaxed);
+			out.futex_waits += stripe.futex_waits.load(::std::memory_order::relaxed);
+			out.wait_time += ::std::chrono::nanoseconds{ stripe.wait_ns.load(::std::memory_order::relaxed) };
+		}
+		return out;
+	}
+
 	concurrent_queue(const concurrent_queue&) = delete;
 	concurrent_queue& operator=(const concurrent_queue&) = delete;
 	concurrent_queue(concurrent_queue&&) = delete;
 	concurrent_queue& operator=(concurrent_queue&&) = delete;
 
 	private:
-	[[gnu::always_inline]] static void wait(node& n, ::uint32_t val) noexcept {
+	[[gnu::always_inline]] void wait(node& n, ::uint32_t val) noexcept {
+		count_futex_wait();
 		n.waiters++;
-		#ifdef __linux__
-		::syscall(SYS_futex, &n.state, FUTEX_WAIT_PRIVATE, val, nullptr, nullptr, 0);
-		#elif defined(_MSC_VER)
-		::WaitOnAddress(&n.state, &val, 4, INFINITE);
-		#endif
+		::jpl::detail::futex_wait(n.state, val);
 		n.waiters--;
 	}
 
+	// Like wait, but gives up after timeout
+	void wait_for(node& n, ::uint32_t val, ::std::chrono::nanoseconds timeout) noexcept {
+		count_futex_wait();
+		n.waiters++;
+		::jpl::detail::futex_wait_for(n.state, val, timeout);
+		n.waiters--;
+	}
+
+	// Time left until deadline, or zero if it has passed
+	template<class Clock, class Duration>
+	static ::std::chrono::nanoseconds time_left(const ::std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+		const auto left = ::std::chrono::ceil<::std::chrono::nanoseconds>(deadline - Clock::now());
+		return left > ::std::chrono::nanoseconds::zero() ? left : ::std::chrono::nanoseconds::zero();
+	}
+
 	[[gnu::always_inline]] static void notify_all(node& n) noexcept {
 		if (!n.waiters) return;
-		#ifdef __linux__
-		::syscall(SYS_futex, &n.state, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
-		#elif defined(_MSC_VER)
-		::WakeByAddressAll(&n.state);
-		#endif
+		::jpl::detail::futex_wake(n.state);
+	}
+
+	// Only for queue_wait::eventcount. Slot waiters are still woken by notify_all, since push_bulk, and push after
+	// taking a turn, sleep on the slot.
+	[[gnu::always_inline]] void notify_consumers(::uint32_t n) noexcept {
+		if constexpr (use_eventcount)
+			events.not_empty.notify(n);
+	}
+
+	[[gnu::always_inline]] void notify_producers(::uint32_t n) noexcept {
+		if constexpr (use_eventcount)
+			events.not_full.notify(n);
+	}
+
+	// Wakes whoever waits for the elements of turns [begin, end), which push_bulk has published
+	void notify_published(::uint32_t begin, ::uint32_t end) noexcept {
+		if (begin == end)
+			return;
+		for (::uint32_t turn_number = begin; turn_number != end; ++turn_number)
+			notify_all(buffer[shuffle_idx(turn_number & mask())]);
+		notify_consumers(end - begin);
+		serve_parked();
+	}
+
+	// Takes the front turn if its element is ready
+	[[gnu::always_inline]] bool try_claim_front(::uint32_t& turn_number, ::uint32_t& idx) noexcept {
+		turn_number = head.load(::std::memory_order::acquire);
+		do {
+			idx = shuffle_idx(turn_number & mask());
+			const ::uint32_t state = buffer[idx].state.load();
+			if ((state != uint32_t(turn_number + 1)))
+				return false;
+		} while (!head.compare_exchange_weak(turn_number, turn_number + 1));
+		return true;
+	}
+
+	// Takes the back turn if the ring buffer isn't full
+	[[gnu::always_inline]] bool try_claim_back(::uint32_t& turn_number) noexcept {
+		turn_number = tail.load(::std::memory_order::acquire);
+		do {
+			if ((turn_number - head.load()) >= capacity())
+				return false;
+		} while (!tail.compare_exchange_weak(turn_number, turn_number + 1));
+		return true;
+	}
+
+	// Whether the front turn's element is ready to be claimed
+	[[gnu::always_inline]] bool front_ready() const noexcept {
+		const ::uint32_t turn_number = head.load(::std::memory_order::acquire);
+		return buffer[shuffle_idx(turn_number & mask())].state.load() == uint32_t(turn_number + 1);
+	}
+
+	// Whether there's room for another push
+	[[gnu::always_inline]] bool back_free() noexcept {
+		return (tail.load(::std::memory_order::acquire) - head.load()) < capacity();
+	}
+
+	// Blocks on ec until claim() succeeds.
+	// A wake can be spent on a thread that finds nothing to claim, since elements get published out of turn order: the
+	// push of turn t + 1 wakes a consumer, which can't take it while turn t is still being published, and goes back to
+	// sleep, and then the push of turn t wakes just one more. So whoever claims after going through ec passes a wake on
+	// as long as more() says there's more to claim.
+	template<class F, class G>
+	void claim_or_sleep(::jpl::detail::eventcount& ec, ::std::atomic<::uint64_t> stat_stripe::* counter, F&& claim, G&& more) noexcept {
+		if (claim()) [[likely]]
+			return;
+		block_stats blocked{ *this, counter };
+		blocked.begin();
+		for (::uint32_t i = 0; i != n_spins; ++i) {
+			::jpl::detail::cpu_relax();
+			if (claim())
+				return;
+		}
+		for (;;) {
+			const ::uint32_t key = ec.prepare_wait();
+			if (claim()) {
+				ec.cancel_wait();
+				break;
+			}
+			count_futex_wait();
+			ec.wait(key);
+		}
+		if (more())
+			ec.notify(1);
+	}
+
+	// Destroys the element of a claimed turn, which has already been moved from, and hands its slot to the turn one lap later
+	[[gnu::always_inline]] void release_slot(::uint32_t idx, ::uint32_t turn_number) noexcept {
+		(buffer[idx].storage.val).~T();
+		buffer[idx].state.store(turn_number + capacity());
+		notify_all(buffer[idx]);
+		notify_producers(1);
+	}
+
+	[[gnu::always_inline]] void release(::uint32_t idx, ::uint32_t turn_number) noexcept {
+		release_slot(idx, turn_number);
+		serve_parked();
+	}
+
+	// For push. With eventcounts, this waits until there's room, and the slot can then only be waited on if its previous
+	// element's consumer is still moving out of it.
+	[[gnu::always_inline]] ::uint32_t take_back_turn() noexcept {
+		if constexpr (use_eventcount) {
+			::uint32_t turn_number;
+			claim_or_sleep(events.not_full, &stat_stripe::blocked_pushes,
+				[&]() noexcept { return try_claim_back(turn_number); }, [&]() noexcept { return back_free(); });
+			return turn_number;
+		} else {
+			return tail.fetch_add(1, ::std::memory_order::acquire);
+		}
 	}
 
 	template<class U>
-	[[gnu::always_inline]] void push_impl(U&& val, ::uint32_t turn_number) noexcept {
-		const ::uint32_t idx = shuffle_idx(turn_number % ring_buffer_size);
+	[[gnu::always_inline]] void publish(U&& val, ::uint32_t turn_number) noexcept {
+		const ::uint32_t idx = shuffle_idx(turn_number & mask());
 		::uint32_t state_val = buffer[idx].state.load(::std::memory_order::acquire);
 		// Mark as unlikely, because this will only wait if ring buffer is full.
-		while (state_val != turn_number) [[unlikely]] {
-			wait(buffer[idx], state_val);
-			state_val = buffer[idx].state.load(::std::memory_order::acquire);
+		if (state_val != turn_number) [[unlikely]] {
+			block_stats blocked{ *this, &stat_stripe::blocked_pushes };
+			blocked.begin();
+			do {
+				wait(buffer[idx], state_val);
+				state_val = buffer[idx].state.load(::std::memory_order::acquire);
+			} while (state_val != turn_number);
 		}
 		::new (&buffer[idx].storage.val) T{ static_cast<U&&>(val) };
 
 		buffer[idx].state.store(turn_number + 1);
 		notify_all(buffer[idx]);
+		notify_consumers(1);
+		sample_size(turn_number + 1);
 	}
 
-	public:
-	[[nodiscard]] T pop() noexcept {
-		const ::uint32_t turn_number = head.fetch_add(1, ::std::memory_order::acquire);
-		const ::uint32_t idx = shuffle_idx(turn_number % ring_buffer_size);
+	template<class U>
+	[[gnu::always_inline]] void push_impl(U&& val, ::uint32_t turn_number) noexcept {
+		publish(static_cast<U&&>(val), turn_number);
+		serve_parked();
+	}
 
-		::uint32_t state_val = buffer[idx].state.load(::std::memory_order::acquire);
-		while (state_val != uint32_t(turn_number + 1)) {
-			wait(buffer[idx], state_val);
-			state_val = buffer[idx].state.load(::std::memory_order::acquire);
+	// try_pop and try_push without serving parked coroutines, for the code that serves them
+	bool take_unserved(::std::optional<T>& out) noexcept {
+		::uint32_t turn_number, idx;
+		if (!try_claim_front(turn_number, idx))
+			return false;
+		out.emplace(static_cast<T&&>(buffer[idx].storage.val));
+		release_slot(idx, turn_number);
+		return true;
+	}
+
+	bool put_unserved(T&& val) noexcept {
+		::uint32_t turn_number;
+		if (!try_claim_back(turn_number))
+			return false;
+		publish(static_cast<T&&>(val), turn_number);
+		return true;
+	}
+
+	[[gnu::always_inline]] void serve_parked() noexcept {
+		if constexpr (with_awaiters) {
+			if (parked.n_parked.load()) [[unlikely]]
+				serve_parked_slow();
 		}
+	}
 
-		T val{ static_cast<T&&>(buffer[idx].storage.val) };
-		(buffer[idx].storage.val).~T();
+	[[gnu::noinline]] void serve_parked_slow() noexcept requires(with_awaiters) {
+		::std::lock_guard lock{ parked.mutex };
+		serve_parked_locked();
+	}
 
-		buffer[idx].state.store(turn_number + ring_buffer_size);
-		notify_all(buffer[idx]);
+	// Hands out elements to parked pops and slots to parked pushes for as long as there are any. Each one served may
+	// make room for, or publish an element for, one of the other kind, so it goes back and forth until neither moves.
+	void serve_parked_locked() noexcept requires(with_awaiters) {
+		for (bool progress = true; progress;) {
+			progress = false;
+			while (parked.pops && take_unserved(parked.pops->val)) {
+				// The awaiter lives in the coroutine frame, which may be gone as soon as it's resumed
+				const ::std::coroutine_handle<> handle = parked.pops->handle;
+				const auto resume = parked.pops->resume;
+				parked.pops = parked.pops->next;
+				if (!parked.pops)
+					parked.pops_end = &parked.pops;
+				parked.n_parked.fetch_sub(1, ::std::memory_order::relaxed);
+				resume(handle);
+				progress = true;
+			}
+			while (parked.pushes && put_unserved(static_cast<T&&>(parked.pushes->val))) {
+				const ::std::coroutine_handle<> handle = parked.pushes->handle;
+				const auto resume = parked.pushes->resume;
+				parked.pushes = parked.pushes->next;
+				if (!parked.pushes)
+					parked.pushes_end = &parked.pushes;
+				parked.n_parked.fetch_sub(1, ::std::memory_order::relaxed);
+				resume(handle);
+				progress = true;
+			}
+		}
+	}
 
-		return val;
+	// Returns false if the awaiter got what it was waiting for after all, and shouldn't suspend
+	bool park(pop_awaiter& awaiter) noexcept requires(with_awaiters) {
+		::std::lock_guard lock{ parked.mutex };
+		parked.n_parked.fetch_add(1);
+		if (take_unserved(awaiter.val)) {
+			parked.n_parked.fetch_sub(1, ::std::memory_order::relaxed);
+			// The slot it freed may be what a parked push is waiting for
+			serve_parked_locked();
+			return false;
+		}
+		*parked.pops_end = &awaiter;
+		parked.pops_end = &awaiter.next;
+		return true;
 	}
 
-	[[nodiscard]] optional_t try_pop() noexcept {
-		::uint32_t turn_number = head.load(::std::memory_order::acquire);
-		::uint32_t idx;
-		do {
-			idx = shuffle_idx(turn_number % ring_buffer_size);
+	bool park(push_awaiter& awaiter) noexcept requires(with_awaiters) {
+		::std::lock_guard lock{ parked.mutex };
+		parked.n_parked.fetch_add(1);
+		if (put_unserved(static_cast<T&&>(awaiter.val))) {
+			parked.n_parked.fetch_sub(1, ::std::memory_order::relaxed);
+			serve_parked_locked();
+			return false;
+		}
+		*parked.pushes_end = &awaiter;
+		parked.pushes_end = &awaiter.next;
+		return true;
+	}
+
+	// The timed operations never take a turn before its slot is ready, since a turn can't be given back once it's
+	// taken, and a later turn might already belong to someone else. Instead, they sleep on the slot of the current
+	// turn, and take it with a compare-exchange once it's ready, like try_pop and try_push.
+
+	// Calls take(T&) with the element, and returns true, if one could be popped before deadline
+	template<class Clock, class Duration, class F>
+	bool pop_until_impl(const ::std::chrono::time_point<Clock, Duration>& deadline, F&& take) noexcept {
+		block_stats blocked{ *this, &stat_stripe::blocked_pops };
+		for (;;) {
+			::uint32_t turn_number = head.load(::std::memory_order::acquire);
+			const ::uint32_t idx = shuffle_idx(turn_number & mask());
 			const ::uint32_t state = buffer[idx].state.load();
-			if ((state != uint32_t(turn_number + 1)))
-				return {};
-		} while (!head.compare_exchange_weak(turn_number, turn_number + 1));
+			if (state == uint32_t(turn_number + 1)) {
+				if (!head.compare_exchange_weak(turn_number, turn_number + 1))
+					continue;
+				take(buffer[idx].storage.val);
+				release(idx, turn_number);
+				return true;
+			}
+			// Someone else took the turn in the meantime, so sleeping on its slot could mean missing the next one
+			if (head.load() != turn_number)
+				continue;
+			const ::std::chrono::nanoseconds left = time_left(deadline);
+			if (left == ::std::chrono::nanoseconds::zero())
+				return false;
+			blocked.begin();
+			wait_for(buffer[idx], state, left);
+		}
+	}
 
-		optional_t val{ static_cast<T&&>(buffer[idx].storage.val) };
-		(buffer[idx].storage.val).~T();
+	template<class Clock, class Duration, class U>
+	bool push_until_impl(const ::std::chrono::time_point<Clock, Duration>& deadline, U&& val) noexcept {
+		block_stats blocked{ *this, &stat_stripe::blocked_pushes };
+		for (;;) {
+			::uint32_t turn_number = tail.load(::std::memory_order::acquire);
+			const ::uint32_t idx = shuffle_idx(turn_number & mask());
+			const ::uint32_t state = buffer[idx].state.load();
+			if (state == turn_number) {
+				if (!tail.compare_exchange_weak(turn_number, turn_number + 1))
+					continue;
+				push_impl(static_cast<U&&>(val), turn_number);
+				return true;
+			}
+			if (tail.load() != turn_number)
+				continue;
+			const ::std::chrono::nanoseconds left = time_left(deadline);
+			if (left == ::std::chrono::nanoseconds::zero())
+				return false;
+			blocked.begin();
+			wait_for(buffer[idx], state, left);
+		}
+	}
 
-		buffer[idx].state.store(turn_number + ring_buffer_size);
-		notify_all(buffer[idx]);
+	public:
+	[[nodiscard]] T pop() noexcept {
+		::uint32_t turn_number, idx;
+		if constexpr (use_eventcount) {
+			claim_or_sleep(events.not_empty, &stat_stripe::blocked_pops,
+				[&]() noexcept { return try_claim_front(turn_number, idx); }, [&]() noexcept { return front_ready(); });
+		} else {
+			turn_number = head.fetch_add(1, ::std::memory_order::acquire);
+			idx = shuffle_idx(turn_number & mask());
+
+			::uint32_t state_val = buffer[idx].state.load(::std::memory_order::acquire);
+			if (state_val != uint32_t(turn_number + 1)) {
+				block_stats blocked{ *this, &stat_stripe::blocked_pops };
+				blocked.begin();
+				do {
+					wait(buffer[idx], state_val);
+					state_val = buffer[idx].state.load(::std::memory_order::acquire);
+				} while (state_val != uint32_t(turn_number + 1));
+			}
+		}
 
+		T val{ static_cast<T&&>(buffer[idx].storage.val) };
+		release(idx, turn_number);
+		return val;
+	}
+
+	[[nodiscard]] optional_t try_pop() noexcept {
+		::uint32_t turn_number, idx;
+		if (!try_claim_front(turn_number, idx))
+			return {};
+
+		optional_t val{ static_cast<T&&>(buffer[idx].storage.val) };
+		release(idx, turn_number);
 		return val;
 	}
 
 	[[nodiscard]] bool try_pop(T& out) noexcept requires(::std::is_nothrow_move_assignable_v<T>) {
-		::uint32_t turn_number = head.load(::std::memory_order::acquire);
-		::uint32_t idx;
-		do {
-			idx = shuffle_idx(turn_number % ring_buffer_size);
-			const ::uint32_t state = buffer[idx].state.load();
-			if ((state != uint32_t(turn_number + 1)))
-				return false;
-		} while (!head.compare_exchange_weak(turn_number, turn_number + 1));
+		::uint32_t turn_number, idx;
+		if (!try_claim_front(turn_number, idx))
+			return false;
 
 		out = static_cast<T&&>(buffer[idx].storage.val);
-		(buffer[idx].storage.val).~T();
+		release(idx, turn_number);
+		return true;
+	}
 
-		buffer[idx].state.store(turn_number + ring_buffer_size);
-		notify_all(buffer[idx]);
+	// Like pop, but gives up at deadline, in which case the queue is left untouched
+	template<class Clock, class Duration>
+	[[nodiscard]] optional_t pop_until(const ::std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+		optional_t out{};
+		pop_until_impl(deadline, [&](T& val) noexcept { out = optional_t{ static_cast<T&&>(val) }; });
+		return out;
+	}
 
-		return true;
+	template<class Rep, class Period>
+	[[nodiscard]] optional_t pop_for(const ::std::chrono::duration<Rep, Period>& timeout) noexcept {
+		return pop_until(::std::chrono::steady_clock::now() + timeout);
+	}
+
+	template<class Clock, class Duration>
+	[[nodiscard]] bool pop_until(T& out, const ::std::chrono::time_point<Clock, Duration>& deadline) noexcept
+		requires(::std::is_nothrow_move_assignable_v<T>)
+	{
+		return pop_until_impl(deadline, [&](T& val) noexcept { out = static_cast<T&&>(val); });
+	}
+
+	template<class Rep, class Period>
+	[[nodiscard]] bool pop_for(T& out, const ::std::chrono::duration<Rep, Period>& timeout) noexcept
+		requires(::std::is_nothrow_move_assignable_v<T>)
+	{
+		return pop_until(out, ::std::chrono::steady_clock::now() + timeout);
 	}
 
 	void push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
-		const ::uint32_t turn_number = tail.fetch_add(1, ::std::memory_order::acquire);
-		push_impl(val, turn_number);
+		push_impl(val, take_back_turn());
 	}
 
 	void push(T&& val) noexcept {
-		const ::uint32_t turn_number = tail.fetch_add(1, ::std::memory_order::acquire);
-		push_impl(static_cast<T&&>(val), turn_number);
+		push_impl(static_cast<T&&>(val), take_back_turn());
 	}
 
-	bool try_push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
-		::uint32_t turn_number = tail.load(::std::memory_order::acquire);
+	// Pushes every element of [first, last), taking all of their turns with a single atomic operation, so that they end
+	// up next to each other in the queue. Like push, this waits for free slots when the ring buffer is full.
+	// Sleeping consumers are woken in one go once every element has been published, and only for slots that have any.
+	// Before waiting for a free slot, it wakes the consumers of what it has published so far, since the slot may only
+	// be freed by them, when there are more elements than the ring buffer has room for.
+	template<::std::forward_iterator I, ::std::sentinel_for<I> S>
+		requires(::std::is_nothrow_constructible_v<T, ::std::iter_reference_t<I>>)
+	void push_bulk(I first, S last) noexcept {
+		const ::uint32_t n = ::uint32_t(::std::ranges::distance(first, last));
+		if (n == 0)
+			return;
+		const ::uint32_t first_turn = tail.fetch_add(n, ::std::memory_order::acquire);
+		block_stats blocked{ *this, &stat_stripe::blocked_pushes };
+		::uint32_t notified = first_turn;
+		for (::uint32_t turn_number = first_turn; first != last; ++first, ++turn_number) {
+			const ::uint32_t idx = shuffle_idx(turn_number & mask());
+			::uint32_t state_val = buffer[idx].state.load(::std::memory_order::acquire);
+			if (state_val != turn_number) [[unlikely]] {
+				notify_published(notified, turn_number);
+				notified = turn_number;
+				blocked.begin();
+				do {
+					wait(buffer[idx], state_val);
+					state_val = buffer[idx].state.load(::std::memory_order::acquire);
+				} while (state_val != turn_number);
+			}
+			::new (&buffer[idx].storage.val) T{ *first };
+			buffer[idx].state.store(turn_number + 1);
+		}
+		sample_size(first_turn + n);
+		notify_published(notified, first_turn + n);
+	}
+
+	// Pops up to max elements that are ready, in order, into out, and returns how many it got. Never waits.
+	// The elements are claimed with a single compare-exchange on head, so the batch is contiguous.
+	template<class O>
+		requires(::std::output_iterator<O, T&&>)
+	[[nodiscard]] ::uint32_t pop_bulk(O out, ::uint32_t max) noexcept {
+		::uint32_t turn_number = head.load(::std::memory_order::acquire);
+		::uint32_t n;
 		do {
-			if ((turn_number - head.load()) >= ring_buffer_size)
+			n = 0;
+			while (n != max && buffer[shuffle_idx((turn_number + n) & mask())].state.load() == uint32_t(turn_number + n + 1))
+				++n;
+			if (n == 0)
+				return 0;
+		} while (!head.compare_exchange_weak(turn_number, turn_number + n));
+
+		for (::uint32_t i = 0; i != n; ++i, ++out) {
+			const ::uint32_t idx = shuffle_idx((turn_number + i) & mask());
+			*out = static_cast<T&&>(buffer[idx].storage.val);
+			(buffer[idx].storage.val).~T();
+			buffer[idx].state.store(turn_number + i + capacity());
+		}
+		for (::uint32_t i = 0; i != n; ++i)
+			notify_all(buffer[shuffle_idx((turn_number + i) & mask())]);
+		notify_producers(n);
+		serve_parked();
+		return n;
+	}
+
+	// Awaiters for coroutines running on jpl::tp. Instead of blocking the worker thread, they suspend the coroutine,
+	// and the push or pop that makes it possible to go on completes the operation for it, and resumes it with
+	// jpl::tp::enqueue. Only the awaiters refer to the thread pool, so queues that never use them don't need it.
+	// They need with_awaiters, which costs the queue a cache line for the parked lists, and every push and pop a load
+	// of their count. Without it, neither is there.
+	// Parked coroutines don't hold a turn, so a thread that blocks in pop or push while they wait may
+	// get ahead of them.
+	class pop_awaiter {
+		friend class concurrent_queue;
+		concurrent_queue& queue;
+		::std::optional<T> val{};
+		::std::coroutine_handle<> handle{};
+		void (*resume)(::std::coroutine_handle<>) noexcept{ &::jpl::tp::detail::resume_on_pool };
+		pop_awaiter* next{ nullptr };
+
+		public:
+		explicit pop_awaiter(concurrent_queue& queue) noexcept : queue{ queue } {}
+		pop_awaiter(const pop_awaiter&) = delete;
+		pop_awaiter& operator=(const pop_awaiter&) = delete;
+
+		bool await_ready() noexcept {
+			if (!queue.take_unserved(val))
 				return false;
-		} while (!tail.compare_exchange_weak(turn_number, turn_number + 1));
+			queue.serve_parked();
+			return true;
+		}
+		bool await_suspend(::std::coroutine_handle<> h) noexcept {
+			handle = h;
+			return queue.park(*this);
+		}
+		T await_resume() noexcept {
+			return static_cast<T&&>(*val);
+		}
+	};
+
+	class push_awaiter {
+		friend class concurrent_queue;
+		concurrent_queue& queue;
+		T val;
+		::std::coroutine_handle<> handle{};
+		void (*resume)(::std::coroutine_handle<>) noexcept{ &::jpl::tp::detail::resume_on_pool };
+		push_awaiter* next{ nullptr };
+
+		public:
+		template<class U>
+		push_awaiter(concurrent_queue& queue, U&& val) noexcept : queue{ queue }, val{ static_cast<U&&>(val) } {}
+		push_awaiter(const push_awaiter&) = delete;
+		push_awaiter& operator=(const push_awaiter&) = delete;
+
+		bool await_ready() noexcept {
+			return queue.try_push(static_cast<T&&>(val));
+		}
+		bool await_suspend(::std::coroutine_handle<> h) noexcept {
+			handle = h;
+			return queue.park(*this);
+		}
+		static constexpr void await_resume() noexcept {}
+	};
+
+	// co_await q.async_pop() gives the next element
+	[[nodiscard]] pop_awaiter async_pop() noexcept requires(with_awaiters) {
+		return pop_awaiter{ *this };
+	}
+
+	[[nodiscard]] push_awaiter async_push(const T& val) noexcept requires(with_awaiters && ::std::is_nothrow_copy_constructible_v<T>) {
+		return push_awaiter{ *this, val };
+	}
+
+	[[nodiscard]] push_awaiter async_push(T&& val) noexcept requires(with_awaiters) {
+		return push_awaiter{ *this, static_cast<T&&>(val) };
+	}
+
+	bool try_push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
+		::uint32_t turn_number;
+		if (!try_claim_back(turn_number))
+			return false;
 		push_impl(val, turn_number);
 		return true;
 	}
 
 	bool try_push(T&& val) noexcept {
-		::uint32_t turn_number = tail.load(::std::memory_order::acquire);
-		do {
-			if ((turn_number - head.load()) >= ring_buffer_size)
-				return false;
-		} while (!tail.compare_exchange_weak(turn_number, turn_number + 1));
+		::uint32_t turn_number;
+		if (!try_claim_back(turn_number))
+			return false;
 		push_impl(static_cast<T&&>(val), turn_number);
 		return true;
 	}
+
+	// Like push, but gives up at deadline if the ring buffer stays full, in which case val is left untouched
+	template<class Clock, class Duration>
+	bool push_until(const T& val, const ::std::chrono::time_point<Clock, Duration>& deadline) noexcept
+		requires(::std::is_nothrow_copy_constructible_v<T>)
+	{
+		return push_until_impl(deadline, val);
+	}
+
+	template<class Clock, class Duration>
+	bool push_until(T&& val, const ::std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+		return push_until_impl(deadline, static_cast<T&&>(val));
+	}
+
+	template<class Rep, class Period>
+	bool push_for(const T& val, const ::std::chrono::duration<Rep, Period>& timeout) noexcept
+		requires(::std::is_nothrow_copy_constructible_v<T>)
+	{
+		return push_until_impl(::std::chrono::steady_clock::now() + timeout, val);
+	}
+
+	template<class Rep, class Period>
+	bool push_for(T&& val, const ::std::chrono::duration<Rep, Period>& timeout) noexcept {
+		return push_until_impl(::std::chrono::steady_clock::now() + timeout, static_cast<T&&>(val));
+	}
 };
 
 } // namespace jpl
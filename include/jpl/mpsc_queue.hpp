@@ -0,0 +1,186 @@
+#ifndef JPL_MPSC_QUEUE_HPP
+#define JPL_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <type_traits>
+
+#include <jpl/bits/cache_line.hpp>
+#include <jpl/bits/futex.hpp>
+
+namespace jpl {
+
+// Bounded queue for any number of producer threads and exactly one consumer thread, with the same interface as
+// jpl::concurrent_queue.
+//
+// Producers take turns like in concurrent_queue: a fetch_add on tail, then they publish through the slot's state.
+// The consumer however owns head, so popping is never a compare-exchange loop, and it keeps a cached copy of it that
+// only needs plain loads and stores. head is still published, for try_push to check whether the queue is full.
+// Only producers waiting for the ring buffer to drain are counted per slot. The consumer instead announces which turn
+// it's sleeping on, so that only the producer of that turn makes the wake syscall.
+template<class T, ::uint32_t ring_buffer_size, bool use_optional = true>
+	requires(
+		// Turn numbers are free running, and only wrap around correctly if the size divides 2^32
+		(::std::popcount(ring_buffer_size) == 1)
+		&& ::std::is_nothrow_move_constructible_v<T>
+		&& ::std::is_nothrow_destructible_v<T>
+	)
+class mpsc_queue {
+	struct node {
+		union storage_t {
+			T val;
+			storage_t() noexcept {}
+			~storage_t() noexcept {}
+		};
+		storage_t storage;
+		// turn while free, turn + 1 once the element for turn has been published
+		::std::atomic<::uint32_t> state;
+		// Producers sleeping until the slot is free
+		::std::atomic<::uint32_t> waiters;
+	};
+
+	using optional_t = std::conditional_t<use_optional, ::std::optional<T>, T>;
+
+	alignas(hardware_destructive_interference_size) node buffer[ring_buffer_size];
+	// Consumer's line
+	alignas(hardware_destructive_interference_size) ::std::atomic<::uint32_t> head{ 0 };
+	::uint32_t cached_head{ 0 };
+	// Shared by producers
+	alignas(hardware_destructive_interference_size) ::std::atomic<::uint32_t> tail{ 0 };
+	// Turn the consumer is sleeping on, plus one, or 0 when it isn't sleeping.
+	// Rarely written, so producers can keep this line in their caches.
+	alignas(hardware_destructive_interference_size) ::std::atomic<::uint64_t> consumer_sleeping_on{ 0 };
+
+	// The fences in the wait functions pair with the ones after the state stores in publish and release, so that either
+	// the waiter sees the new state, or the other side sees the waiter.
+
+	template<class U>
+	[[gnu::always_inline]] void publish(U&& val, ::uint32_t turn_number) noexcept {
+		node& n = buffer[turn_number % ring_buffer_size];
+		::new (&n.storage.val) T{ static_cast<U&&>(val) };
+		n.state.store(turn_number + 1, ::std::memory_order::release);
+		::std::atomic_thread_fence(::std::memory_order::seq_cst);
+		if (consumer_sleeping_on.load(::std::memory_order::relaxed) == ::uint64_t(turn_number) + 1) [[unlikely]]
+			::jpl::detail::futex_wake(n.state);
+	}
+
+	template<class U>
+	[[gnu::always_inline]] void push_impl(U&& val) noexcept {
+		const ::uint32_t turn_number = tail.fetch_add(1, ::std::memory_order::relaxed);
+		node& n = buffer[turn_number % ring_buffer_size];
+		::uint32_t state = n.state.load(::std::memory_order::acquire);
+		// Only waits if the ring buffer is full
+		if (state != turn_number) [[unlikely]] {
+			n.waiters.fetch_add(1, ::std::memory_order::relaxed);
+			::std::atomic_thread_fence(::std::memory_order::seq_cst);
+			while ((state = n.state.load(::std::memory_order::acquire)) != turn_number)
+				::jpl::detail::futex_wait(n.state, state);
+			n.waiters.fetch_sub(1, ::std::memory_order::relaxed);
+		}
+		publish(static_cast<U&&>(val), turn_number);
+	}
+
+	void wait_for_front(node& n) noexcept {
+		const ::uint32_t expected = cached_head + 1;
+		::uint32_t state = n.state.load(::std::memory_order::acquire);
+		if (state == expected) [[likely]]
+			return;
+		consumer_sleeping_on.store(::uint64_t(cached_head) + 1, ::std::memory_order::relaxed);
+		::std::atomic_thread_fence(::std::memory_order::seq_cst);
+		while ((state = n.state.load(::std::memory_order::acquire)) != expected)
+			::jpl::detail::futex_wait(n.state, state);
+		consumer_sleeping_on.store(0, ::std::memory_order::relaxed);
+	}
+
+	template<class U>
+	[[gnu::always_inline]] bool try_push_impl(U&& val) noexcept {
+		::uint32_t turn_number = tail.load(::std::memory_order::relaxed);
+		do {
+			// head is stored after the slot's state, so if the slot looks free here, it is
+			if (turn_number - head.load(::std::memory_order::acquire) >= ring_buffer_size)
+				return false;
+		} while (!tail.compare_exchange_weak(turn_number, turn_number + 1, ::std::memory_order::relaxed));
+		publish(static_cast<U&&>(val), turn_number);
+		return true;
+	}
+
+	// Destroys the front element, which has already been moved from, and hands its slot to the turn one lap later
+	[[gnu::always_inline]] void release(node& n) noexcept {
+		n.storage.val.~T();
+		n.state.store(cached_head + ring_buffer_size, ::std::memory_order::release);
+		head.store(++cached_head, ::std::memory_order::release);
+		::std::atomic_thread_fence(::std::memory_order::seq_cst);
+		if (n.waiters.load(::std::memory_order::relaxed)) [[unlikely]]
+			::jpl::detail::futex_wake(n.state);
+	}
+
+	public:
+	mpsc_queue() noexcept {
+		for (::uint32_t i = 0; i != ring_buffer_size; ++i) {
+			buffer[i].state.store(i, ::std::memory_order::relaxed);
+			buffer[i].waiters.store(0, ::std::memory_order::relaxed);
+		}
+	}
+	~mpsc_queue() noexcept {
+		for (::uint32_t h = cached_head, t = tail.load(); h != t; ++h)
+			buffer[h % ring_buffer_size].storage.val.~T();
+	}
+
+	mpsc_queue(const mpsc_queue&) = delete;
+	mpsc_queue& operator=(const mpsc_queue&) = delete;
+	mpsc_queue(mpsc_queue&&) = delete;
+	mpsc_queue& operator=(mpsc_queue&&) = delete;
+
+	// Consumer only
+
+	[[nodiscard]] T pop() noexcept {
+		node& n = buffer[cached_head % ring_buffer_size];
+		wait_for_front(n);
+		T val{ static_cast<T&&>(n.storage.val) };
+		release(n);
+		return val;
+	}
+
+	[[nodiscard]] optional_t try_pop() noexcept {
+		node& n = buffer[cached_head % ring_buffer_size];
+		if (n.state.load(::std::memory_order::acquire) != cached_head + 1)
+			return {};
+		optional_t val{ static_cast<T&&>(n.storage.val) };
+		release(n);
+		return val;
+	}
+
+	[[nodiscard]] bool try_pop(T& out) noexcept requires(::std::is_nothrow_move_assignable_v<T>) {
+		node& n = buffer[cached_head % ring_buffer_size];
+		if (n.state.load(::std::memory_order::acquire) != cached_head + 1)
+			return false;
+		out = static_cast<T&&>(n.storage.val);
+		release(n);
+		return true;
+	}
+
+	// Any thread
+
+	void push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
+		push_impl(val);
+	}
+
+	void push(T&& val) noexcept {
+		push_impl(static_cast<T&&>(val));
+	}
+
+	bool try_push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
+		return try_push_impl(val);
+	}
+
+	bool try_push(T&& val) noexcept {
+		return try_push_impl(static_cast<T&&>(val));
+	}
+};
+
+} // namespace jpl
+
+#endif // JPL_MPSC_QUEUE_HPP
@@ -0,0 +1,153 @@
+#ifndef JPL_MULTIQUEUE_HPP
+#define JPL_MULTIQUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+
+#include <jpl/random.hpp>
+#include <jpl/vector.hpp>
+#include <jpl/bits/cache_line.hpp>
+
+namespace jpl {
+
+// Relaxed MPMC priority queue. try_pop returns one of the elements with the lowest priorities, but not necessarily
+// the lowest one.
+//
+// It's a multiqueue: a number of binary heaps, each behind its own mutex. push puts the element into a random heap,
+// and try_pop looks at the tops of two random heaps and pops from the lower one. Both only ever try_lock, and pick
+// other heaps instead of waiting, so with a couple of heaps per thread they rarely get in each other's way. The size
+// and top of every heap are copied into atomics, so that picking one doesn't take its lock.
+// With two choices, the expected rank of a popped element among everything in the queue is O(number of heaps), no
+// matter how many elements there are (Rihani, Sanders & Dementiev: "MultiQueues: Simpler, Faster, and Better Relaxed
+// Concurrent Priority Queues", 2015). Elements with the same priority come out in no particular order.
+template<class T, class Priority = ::uint64_t>
+	requires(
+		::std::totally_ordered<Priority>
+		&& ::std::is_trivially_copyable_v<Priority>
+		&& ::std::is_nothrow_move_constructible_v<T>
+		&& ::std::is_nothrow_move_assignable_v<T>
+		&& ::std::is_nothrow_destructible_v<T>
+	)
+class multiqueue {
+	struct entry {
+		Priority priority;
+		T val;
+		// std::push_heap builds a max-heap, so this puts the lowest priority on top
+		friend bool operator<(const entry& a, const entry& b) noexcept {
+			return b.priority < a.priority;
+		}
+	};
+
+	struct alignas(hardware_destructive_interference_size) heap {
+		::std::mutex mutex;
+		::jpl::vector<entry> entries;
+		::std::atomic<::uint32_t> size{ 0 };
+		::std::atomic<Priority> top{};
+
+		// Called with the mutex held, after every change
+		void publish() noexcept {
+			if (!entries.empty())
+				top.store(entries.front().priority, ::std::memory_order::relaxed);
+			size.store(::uint32_t(entries.size()), ::std::memory_order::relaxed);
+		}
+
+		T pop() noexcept {
+			::std::pop_heap(entries.begin(), entries.end());
+			T val{ static_cast<T&&>(entries.back().val) };
+			entries.pop_back();
+			publish();
+			return val;
+		}
+	};
+
+	::std::unique_ptr<heap[]> heaps;
+	::uint32_t n_heaps;
+
+	// Seeded explicitly, since pcg32's default seed needs RDSEED, and so -mrdseed. Threads only need streams that
+	// differ, so they take golden ratio steps through the seeds.
+	::uint32_t random_heap() const noexcept {
+		static ::std::atomic<::uint64_t> next_seed{ 0 };
+		thread_local ::jpl::pcg32 rng{ next_seed.fetch_add(0x9e3779b97f4a7c15ull, ::std::memory_order::relaxed) };
+		return ::uint32_t((::uint64_t(rng()) * n_heaps) >> 32);
+	}
+
+	// Of the two, the heap with the lower top, or n_heaps if both look empty
+	::uint32_t pick(::uint32_t i, ::uint32_t j) const noexcept {
+		const bool has_i = heaps[i].size.load(::std::memory_order::relaxed) != 0;
+		const bool has_j = heaps[j].size.load(::std::memory_order::relaxed) != 0;
+		if (has_i && has_j)
+			return heaps[j].top.load(::std::memory_order::relaxed) < heaps[i].top.load(::std::memory_order::relaxed) ? j : i;
+		return has_i ? i : has_j ? j : n_heaps;
+	}
+
+	public:
+	// Two heaps per hardware thread by default. More heaps means less contention, but a bigger rank error.
+	explicit multiqueue(::uint32_t n_heaps = 2 * ::std::max(::std::thread::hardware_concurrency(), 1u))
+		: heaps{ ::std::make_unique<heap[]>(n_heaps ? n_heaps : 1) }, n_heaps{ n_heaps ? n_heaps : 1 } {}
+
+	multiqueue(const multiqueue&) = delete;
+	multiqueue& operator=(const multiqueue&) = delete;
+	multiqueue(multiqueue&&) = delete;
+	multiqueue& operator=(multiqueue&&) = delete;
+
+	[[nodiscard]] ::uint32_t heap_count() const noexcept {
+		return n_heaps;
+	}
+
+	// Throws whatever the heap's vector throws when it grows, in which case val is left untouched
+	void push(Priority priority, T&& val) {
+		for (;;) {
+			heap& h = heaps[random_heap()];
+			::std::unique_lock lock{ h.mutex, ::std::try_to_lock };
+			if (!lock)
+				continue;
+			h.entries.emplace_back(priority, static_cast<T&&>(val));
+			::std::push_heap(h.entries.begin(), h.entries.end());
+			h.publish();
+			return;
+		}
+	}
+
+	void push(Priority priority, const T& val) requires(::std::is_copy_constructible_v<T>) {
+		T copy{ val };
+		push(priority, static_cast<T&&>(copy));
+	}
+
+	// Only returns nothing after finding every heap empty, so like concurrent_queue::try_pop, it doesn't give up while
+	// there are elements that nobody else is popping.
+	[[nodiscard]] ::std::optional<T> try_pop() noexcept {
+		for (;;) {
+			const ::uint32_t i = pick(random_heap(), random_heap());
+			if (i == n_heaps)
+				break;
+			heap& h = heaps[i];
+			::std::unique_lock lock{ h.mutex, ::std::try_to_lock };
+			// Someone else is using it, or emptied it in the meantime, so try another pair
+			if (!lock || h.entries.empty())
+				continue;
+			return h.pop();
+		}
+		// Both picks were empty, so before giving up, look through all the heaps, starting from a random one
+		const ::uint32_t start = random_heap();
+		for (::uint32_t k = 0; k != n_heaps; ++k) {
+			heap& h = heaps[start + k < n_heaps ? start + k : start + k - n_heaps];
+			if (h.size.load(::std::memory_order::relaxed) == 0)
+				continue;
+			::std::lock_guard lock{ h.mutex };
+			if (!h.entries.empty())
+				return h.pop();
+		}
+		return ::std::nullopt;
+	}
+};
+
+} // namespace jpl
+
+#endif // JPL_MULTIQUEUE_HPP
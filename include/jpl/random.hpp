@@ -28,7 +28,7 @@ class pcg32 {
 	static constexpr ::uint64_t mult{ 6364136223846793005ull };
 
 	static constexpr ::uint32_t rotr(::uint32_t i, ::uint32_t n) noexcept {
-		return (i >> (n % 32)) | (i << (32 - (n % 32)));
+		return (i >> (n % 32)) | (i << ((32 - n) % 32));
 	}
 
 	public:
@@ -0,0 +1,320 @@
+#ifndef JPL_SEGMENTED_QUEUE_HPP
+#define JPL_SEGMENTED_QUEUE_HPP
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include <jpl/bits/cache_line.hpp>
+#include <jpl/bits/cpu_relax.hpp>
+#include <jpl/bits/futex.hpp>
+
+namespace jpl {
+
+// Unbounded MPMC queue, with the same interface as jpl::concurrent_queue, except that push never waits.
+//
+// Turns are handed out by fetch_add on 64-bit head and tail counters, like in concurrent_queue, but instead of
+// wrapping around a ring buffer, turn t lives in slot t % segment_size of segment t / segment_size, in a linked
+// list of segments. Each slot is used once per segment, so its state only goes from empty to full to consumed.
+//
+// The producer that gets the first turn of a segment is the one that appends it, so linking never races. Everyone
+// else with a turn in it waits for it to appear, which takes about as long as popping a freelist. If that has to
+// allocate, and allocation fails, push terminates, since it's noexcept like the rest of the queue.
+// Once every slot of the oldest segment has been consumed, it's unlinked and put on a freelist, so in the steady
+// state nothing is allocated. Segments are only freed by the destructor. That way a thread that's still holding a
+// pointer to a recycled segment can always read it, and it notices by the segment's id, which is never reused.
+template<class T, ::uint32_t segment_size = 1024, bool use_optional = true>
+	requires(
+		(::std::popcount(segment_size) == 1)
+		// To ensure integrity of the queue, all operations must be noexcept, which means that the stored type must be
+		// noexcept movable and destructible.
+		&& ::std::is_nothrow_move_constructible_v<T>
+		&& ::std::is_nothrow_destructible_v<T>
+	)
+class segmented_queue {
+	enum : ::uint32_t { empty, full, consumed };
+
+	struct node {
+		union storage_t {
+			T val;
+			storage_t() noexcept {}
+			~storage_t() noexcept {}
+		};
+		storage_t storage;
+		::std::atomic<::uint32_t> waiters{ 0 };
+		::std::atomic<::uint32_t> state{ empty };
+	};
+
+	static constexpr ::uint64_t retired{ UINT64_MAX };
+
+	struct segment {
+		// Index of the segment in the queue, or retired while it's on the freelist
+		alignas(hardware_destructive_interference_size) ::std::atomic<::uint64_t> id{ 0 };
+		::std::atomic<segment*> next{ nullptr };
+		// The low 2 bits are 0 until next is set, 1 after, and 2 while someone is sleeping on it. The rest are the low
+		// bits of id, so that a thread that's about to sleep on a segment that has been recycled since doesn't.
+		::std::atomic<::uint32_t> next_ready{ 0 };
+		alignas(hardware_destructive_interference_size) ::std::atomic<::uint32_t> n_consumed{ 0 };
+		segment* next_free{ nullptr };
+		alignas(hardware_destructive_interference_size) node slots[segment_size];
+
+		void reset(::uint64_t new_id) noexcept {
+			for (node& n : slots)
+				n.state.store(empty, ::std::memory_order::relaxed);
+			n_consumed.store(0, ::std::memory_order::relaxed);
+			next_ready.store(ready_key(new_id), ::std::memory_order::relaxed);
+			next.store(nullptr, ::std::memory_order::relaxed);
+			id.store(new_id, ::std::memory_order::release);
+		}
+	};
+
+	// next_ready of segment id while it has no successor, and nobody is waiting for one
+	static constexpr ::uint32_t ready_key(::uint64_t id) noexcept {
+		return ::uint32_t(id) << 2;
+	}
+
+	using optional_t = std::conditional_t<use_optional, ::std::optional<T>, T>;
+
+	alignas(hardware_destructive_interference_size) ::std::atomic<::uint64_t> head{ 0 };
+	alignas(hardware_destructive_interference_size) ::std::atomic<::uint64_t> tail{ 0 };
+	// Oldest and newest linked segments. Both are only hints for where to start looking, since a thread can still be
+	// working with a segment after these have moved on.
+	alignas(hardware_destructive_interference_size) ::std::atomic<segment*> head_segment;
+	::std::atomic<segment*> tail_segment;
+	// Guards the freelist and unlinking, which only happen once per segment
+	alignas(hardware_destructive_interference_size) ::std::mutex segment_mutex;
+	segment* free_segments{ nullptr };
+	::size_t n_allocated{ 1 };
+
+	segment* acquire_segment(::uint64_t id) {
+		segment* seg;
+		{
+			::std::lock_guard lock{ segment_mutex };
+			seg = free_segments;
+			if (seg) {
+				free_segments = seg->next_free;
+			} else {
+				++n_allocated;
+			}
+		}
+		if (!seg)
+			seg = new segment;
+		seg->reset(id);
+		return seg;
+	}
+
+	// Unlinks fully consumed segments from the front. If another thread is already at it, it will see this one too,
+	// or if it doesn't, the next segment to be consumed takes care of it.
+	void retire_segments() noexcept {
+		::std::unique_lock lock{ segment_mutex, ::std::try_to_lock };
+		if (!lock)
+			return;
+		for (;;) {
+			segment* seg = head_segment.load(::std::memory_order::relaxed);
+			segment* next = seg->next.load(::std::memory_order::acquire);
+			// The newest segment stays, even if it's consumed, since it's the one that the next one gets linked to
+			if (!next || seg->n_consumed.load(::std::memory_order::acquire) != segment_size)
+				return;
+			head_segment.store(next, ::std::memory_order::release);
+			seg->id.store(retired, ::std::memory_order::release);
+			seg->next_free = free_segments;
+			free_segments = seg;
+		}
+	}
+
+	// Blocks until seg, which was segment id without a successor, has one, or until it turns out to have been
+	// recycled in the meantime. It's keyed on the id, since recycling clears the ready bits, and otherwise only the
+	// successor of the segment's next life would wake it.
+	static void wait_for_next(segment* seg, ::uint64_t id) noexcept {
+		const ::uint32_t key = ready_key(id);
+		for (::uint32_t i = 0; i != 64; ++i) {
+			if (seg->next_ready.load(::std::memory_order::acquire) != key)
+				return;
+			::jpl::detail::cpu_relax();
+		}
+		::uint32_t ready = key;
+		if (seg->next_ready.compare_exchange_strong(ready, key | 2, ::std::memory_order::acquire) || ready == (key | 2))
+			::jpl::detail::futex_wait(seg->next_ready, key | 2);
+	}
+
+	enum class find_mode {
+		wait,   // Wait for the segment to be appended
+		create, // The caller has the first turn in the segment, so it appends it
+		peek,   // Return nullptr instead of waiting
+	};
+
+	// Segment k, starting the search from the hint. With peek, it also returns nullptr if segment k has already been
+	// retired. The other modes never return nullptr, since the caller has an unfinished turn in it, so it can't be.
+	segment* find_segment(::uint64_t k, ::std::atomic<segment*>& hint, find_mode mode) noexcept {
+		segment* seg = hint.load(::std::memory_order::acquire);
+		for (;;) {
+			const ::uint64_t id = seg->id.load(::std::memory_order::acquire);
+			if (id == k)
+				return seg;
+			if (id > k) {
+				// Behind the hint, or the hint has been recycled, so start over from the oldest one
+				segment* oldest = head_segment.load(::std::memory_order::acquire);
+				const ::uint64_t oldest_id = oldest->id.load(::std::memory_order::acquire);
+				if (oldest_id != retired && oldest_id > k) {
+					if (mode == find_mode::peek)
+						return nullptr;
+					// Segment k is still linked, so the oldest one was recycled as a new tail between loading it and
+					// reading its id, and head_segment has moved on since
+					::jpl::detail::cpu_relax();
+					continue;
+				}
+				seg = oldest;
+				continue;
+			}
+			segment* next = seg->next.load(::std::memory_order::acquire);
+			// Recycling changes the id before next, so if it's unchanged, next really belongs to segment id
+			if (seg->id.load(::std::memory_order::acquire) != id)
+				continue;
+			if (next) {
+				seg = next;
+				continue;
+			}
+			// The newest segment can't be recycled before it has a successor, and the caller is the one to append it,
+			// so seg stays segment id until then
+			if (mode == find_mode::create && id + 1 == k) {
+				segment* fresh = acquire_segment(k);
+				seg->next.store(fresh, ::std::memory_order::release);
+				if ((seg->next_ready.exchange(ready_key(id) | 1, ::std::memory_order::release) & 3) == 2)
+					::jpl::detail::futex_wake(seg->next_ready);
+				tail_segment.store(fresh, ::std::memory_order::release);
+				return fresh;
+			}
+			if (mode == find_mode::peek)
+				return nullptr;
+			// Someone else appends the successor, after which seg can be consumed, retired and recycled at any time,
+			// even before this thread gets to sleep on it
+			wait_for_next(seg, id);
+		}
+	}
+
+	template<class U>
+	[[gnu::always_inline]] void push_impl(U&& val) noexcept {
+		const ::uint64_t turn_number = tail.fetch_add(1, ::std::memory_order::acquire);
+		const find_mode mode = (turn_number % segment_size == 0) ? find_mode::create : find_mode::wait;
+		segment* seg = find_segment(turn_number / segment_size, tail_segment, mode);
+		node& n = seg->slots[turn_number % segment_size];
+		::new (&n.storage.val) T{ static_cast<U&&>(val) };
+		n.state.store(full);
+		if (n.waiters.load()) [[unlikely]]
+			::jpl::detail::futex_wake(n.state);
+	}
+
+	// Destroys the element, which has already been moved from, and retires the segment if it was the last one in it
+	[[gnu::always_inline]] void release(segment* seg, node& n) noexcept {
+		(n.storage.val).~T();
+		n.state.store(consumed, ::std::memory_order::relaxed);
+		if (seg->n_consumed.fetch_add(1, ::std::memory_order::acq_rel) == segment_size - 1) [[unlikely]]
+			retire_segments();
+	}
+
+	template<class F>
+	[[gnu::always_inline]] bool try_pop_impl(F&& take) noexcept {
+		::uint64_t turn_number = head.load(::std::memory_order::acquire);
+		for (;;) {
+			if (turn_number >= tail.load(::std::memory_order::acquire))
+				return false;
+			segment* seg = find_segment(turn_number / segment_size, head_segment, find_mode::peek);
+			node* n = seg ? &seg->slots[turn_number % segment_size] : nullptr;
+			if (!n || n->state.load() != full) {
+				const ::uint64_t current = head.load(::std::memory_order::acquire);
+				// The producer of the front turn hasn't finished yet
+				if (current == turn_number)
+					return false;
+				turn_number = current;
+				continue;
+			}
+			if (head.compare_exchange_weak(turn_number, turn_number + 1)) {
+				take(static_cast<T&&>(n->storage.val));
+				release(seg, *n);
+				return true;
+			}
+		}
+	}
+
+	public:
+	segmented_queue() {
+		segment* first = new segment;
+		head_segment.store(first, ::std::memory_order::relaxed);
+		tail_segment.store(first, ::std::memory_order::relaxed);
+	}
+	~segmented_queue() noexcept {
+		segment* seg = head_segment.load();
+		while (seg) {
+			for (node& n : seg->slots)
+				if (n.state.load(::std::memory_order::relaxed) == full)
+					(n.storage.val).~T();
+			delete ::std::exchange(seg, seg->next.load(::std::memory_order::relaxed));
+		}
+		while (free_segments)
+			delete ::std::exchange(free_segments, free_segments->next_free);
+	}
+
+	segmented_queue(const segmented_queue&) = delete;
+	segmented_queue& operator=(const segmented_queue&) = delete;
+	segmented_queue(segmented_queue&&) = delete;
+	segmented_queue& operator=(segmented_queue&&) = delete;
+
+	// Number of segments allocated so far, including the ones on the freelist
+	::size_t allocated_segments() noexcept {
+		::std::lock_guard lock{ segment_mutex };
+		return n_allocated;
+	}
+
+	[[nodiscard]] T pop() noexcept {
+		const ::uint64_t turn_number = head.fetch_add(1, ::std::memory_order::acquire);
+		segment* seg = find_segment(turn_number / segment_size, head_segment, find_mode::wait);
+		node& n = seg->slots[turn_number % segment_size];
+		while (n.state.load(::std::memory_order::acquire) != full) {
+			n.waiters++;
+			::jpl::detail::futex_wait(n.state, empty);
+			n.waiters--;
+		}
+		T val{ static_cast<T&&>(n.storage.val) };
+		release(seg, n);
+		return val;
+	}
+
+	[[nodiscard]] optional_t try_pop() noexcept {
+		optional_t out{};
+		try_pop_impl([&](T&& val) noexcept { out = optional_t{ static_cast<T&&>(val) }; });
+		return out;
+	}
+
+	[[nodiscard]] bool try_pop(T& out) noexcept requires(::std::is_nothrow_move_assignable_v<T>) {
+		return try_pop_impl([&](T&& val) noexcept { out = static_cast<T&&>(val); });
+	}
+
+	// Allocates a new segment when the last one fills up, unless there's one on the freelist
+	void push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
+		push_impl(val);
+	}
+
+	void push(T&& val) noexcept {
+		push_impl(static_cast<T&&>(val));
+	}
+
+	// Never fails, only there for interface parity with concurrent_queue
+	bool try_push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
+		push_impl(val);
+		return true;
+	}
+
+	bool try_push(T&& val) noexcept {
+		push_impl(static_cast<T&&>(val));
+		return true;
+	}
+};
+
+} // namespace jpl
+
+#endif // JPL_SEGMENTED_QUEUE_HPP
@@ -0,0 +1,223 @@
+#ifndef JPL_SHARDED_QUEUE_HPP
+#define JPL_SHARDED_QUEUE_HPP
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+#include <jpl/concurrent_queue.hpp>
+#include <jpl/vector.hpp>
+#include <jpl/bits/cpu_relax.hpp>
+#include <jpl/bits/eventcount.hpp>
+#include <jpl/bits/topology.hpp>
+
+namespace jpl {
+
+// MPMC queue made of one jpl::concurrent_queue per NUMA node, each allocated on its own node. Of concurrent_queue's
+// interface, it has pop, try_pop, push, try_push and capacity, but no timed, bulk or async operations, no empty and
+// no stats.
+//
+// Threads push to the shard of the node they're running on, and pop from it too, only falling back to the other
+// shards when it's empty. So as long as every node has enough consumers, the cache lines of a shard, and the elements
+// in it, stay on their node.
+// Order is only FIFO within a shard. Elements pushed on a node without consumers are only popped by other nodes'
+// consumers when their own shards are empty.
+//
+// Blocked consumers sleep on a shared eventcount, and can take an element from any shard, so every push wakes at
+// most one of them, and makes no syscall when none are asleep. A woken consumer that takes an element wakes the next
+// one while there's more, since a wake can be spent on a shard whose front element is still being pushed.
+// A push only blocks if every shard is full, and then it waits for room in its own.
+template<class T, ::uint32_t ring_buffer_size, bool use_optional = true>
+	requires(
+		(::std::popcount(ring_buffer_size) == 1)
+		&& ::std::is_nothrow_move_constructible_v<T>
+		&& ::std::is_nothrow_destructible_v<T>
+	)
+class sharded_queue {
+	// Shards always return std::optional, so that popping a T{} can be told apart from finding nothing
+	using shard = ::jpl::concurrent_queue<T, ring_buffer_size, true>;
+	using optional_t = std::conditional_t<use_optional, ::std::optional<T>, T>;
+
+	// Tries before a blocking pop sleeps
+	static constexpr ::uint32_t n_spins{ 64 };
+
+	::jpl::vector<shard*> shards;
+	// Shard of each CPU id
+	::jpl::vector<::uint32_t> cpu_shard;
+	::jpl::detail::eventcount not_empty;
+
+	void build(const ::jpl::detail::topology& topo, ::uint32_t n_shards) {
+		// With a shard per node, the shards are the nodes. Otherwise usable CPUs are split into n_shards runs in id
+		// order. Either way, a shard's memory is on the node of its first CPU.
+		::jpl::vector<::uint32_t> shard_node;
+		shard_node.resize(n_shards, ::jpl::detail::no_node);
+		cpu_shard.resize(topo.cpu_node.size(), 0);
+		::uint32_t n_cpus = 0;
+		for (::uint32_t node : topo.cpu_node)
+			n_cpus += node != ::jpl::detail::no_node;
+		for (::uint32_t cpu = 0, i = 0; cpu != topo.cpu_node.size(); ++cpu) {
+			const ::uint32_t node = topo.cpu_node[cpu];
+			if (node == ::jpl::detail::no_node)
+				continue;
+			const ::uint32_t s = n_shards == topo.n_nodes ? node : ::uint32_t(::uint64_t(i++) * n_shards / n_cpus);
+			cpu_shard[cpu] = s;
+			if (shard_node[s] == ::jpl::detail::no_node)
+				shard_node[s] = topo.node_ids[node];
+		}
+		shards.reserve(n_shards);
+		try {
+			for (::uint32_t node_id : shard_node)
+				shards.push_back(::jpl::detail::new_on_node<shard>(node_id == ::jpl::detail::no_node ? topo.node_ids[0] : node_id));
+		} catch (...) {
+			for (shard* s : shards)
+				::jpl::detail::delete_on_node(s);
+			throw;
+		}
+	}
+
+	[[gnu::always_inline]] ::uint32_t local_shard() const noexcept {
+		if (shards.size() == 1)
+			return 0;
+		return shard_of_cpu(::jpl::detail::current_cpu());
+	}
+
+	// Calls f with the local shard first, then the others, until it returns true
+	template<class F>
+	[[gnu::always_inline]] bool for_shards(F&& f) noexcept {
+		const ::uint32_t n = ::uint32_t(shards.size());
+		const ::uint32_t local = local_shard();
+		for (::uint32_t i = 0; i != n; ++i) {
+			const ::uint32_t s = local + i < n ? local + i : local + i - n;
+			if (f(*shards[s]))
+				return true;
+		}
+		return false;
+	}
+
+	[[gnu::always_inline]] ::std::optional<T> take() noexcept {
+		::std::optional<T> out;
+		for_shards([&](shard& s) noexcept {
+			::std::optional<T> val = s.try_pop();
+			if (!val)
+				return false;
+			out.emplace(static_cast<T&&>(*val));
+			return true;
+		});
+		return out;
+	}
+
+	// Whether any shard has an element ready to be taken
+	bool any_ready() const noexcept {
+		for (const shard* s : shards)
+			if (!s->empty())
+				return true;
+		return false;
+	}
+
+	template<class U>
+	[[gnu::always_inline]] void push_impl(U&& val) noexcept {
+		// try_push leaves val alone when it fails
+		if (!for_shards([&](shard& s) noexcept { return s.try_push(static_cast<U&&>(val)); })) [[unlikely]]
+			shards[local_shard()]->push(static_cast<U&&>(val));
+		not_empty.notify(1);
+	}
+
+	template<class U>
+	[[gnu::always_inline]] bool try_push_impl(U&& val) noexcept {
+		if (!for_shards([&](shard& s) noexcept { return s.try_push(static_cast<U&&>(val)); }))
+			return false;
+		not_empty.notify(1);
+		return true;
+	}
+
+	public:
+	// One shard per NUMA node the process can run on, or a single one if there's no NUMA information
+	sharded_queue() {
+		const ::jpl::detail::topology topo = ::jpl::detail::read_topology();
+		build(topo, topo.n_nodes);
+	}
+
+	// Splits the usable CPUs into n_shards groups instead, for example to try out sharding on a single node machine
+	explicit sharded_queue(::uint32_t n_shards) {
+		build(::jpl::detail::read_topology(), n_shards ? n_shards : 1);
+	}
+
+	~sharded_queue() noexcept {
+		for (shard* s : shards)
+			::jpl::detail::delete_on_node(s);
+	}
+
+	sharded_queue(const sharded_queue&) = delete;
+	sharded_queue& operator=(const sharded_queue&) = delete;
+	sharded_queue(sharded_queue&&) = delete;
+	sharded_queue& operator=(sharded_queue&&) = delete;
+
+	[[nodiscard]] ::uint32_t n_shards() const noexcept {
+		return ::uint32_t(shards.size());
+	}
+
+	// Shard that threads running on the CPU push to and pop from first
+	[[nodiscard]] ::uint32_t shard_of_cpu(::uint32_t cpu) const noexcept {
+		return cpu < cpu_shard.size() ? cpu_shard[cpu] : 0;
+	}
+
+	// Total size of the ring buffers
+	[[nodiscard]] ::uint32_t capacity() const noexcept {
+		return ::uint32_t(shards.size()) * ring_buffer_size;
+	}
+
+	[[nodiscard]] T pop() noexcept {
+		for (::uint32_t i = 0; i != n_spins; ++i) {
+			if (::std::optional<T> val = take())
+				return static_cast<T&&>(*val);
+			::jpl::detail::cpu_relax();
+		}
+		for (;;) {
+			const ::uint32_t key = not_empty.prepare_wait();
+			if (::std::optional<T> val = take()) {
+				not_empty.cancel_wait();
+				// The push that woke this one may not be the one whose element it got
+				if (any_ready())
+					not_empty.notify(1);
+				return static_cast<T&&>(*val);
+			}
+			not_empty.wait(key);
+		}
+	}
+
+	[[nodiscard]] optional_t try_pop() noexcept {
+		if constexpr (use_optional) {
+			return take();
+		} else {
+			::std::optional<T> val = take();
+			return val ? optional_t{ static_cast<T&&>(*val) } : optional_t{};
+		}
+	}
+
+	[[nodiscard]] bool try_pop(T& out) noexcept requires(::std::is_nothrow_move_assignable_v<T>) {
+		return for_shards([&](shard& s) noexcept { return s.try_pop(out); });
+	}
+
+	// Goes to another shard if the local one is full, and only blocks if every shard is
+	void push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
+		push_impl(val);
+	}
+
+	void push(T&& val) noexcept {
+		push_impl(static_cast<T&&>(val));
+	}
+
+	bool try_push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
+		return try_push_impl(val);
+	}
+
+	bool try_push(T&& val) noexcept {
+		return try_push_impl(static_cast<T&&>(val));
+	}
+};
+
+} // namespace jpl
+
+#endif // JPL_SHARDED_QUEUE_HPP
@@ -0,0 +1,181 @@
+#ifndef JPL_SPSC_QUEUE_HPP
+#define JPL_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <type_traits>
+
+#include <jpl/bits/cache_line.hpp>
+#include <jpl/bits/futex.hpp>
+
+namespace jpl {
+
+// Bounded queue for exactly one producer thread and one consumer thread, with the same interface as
+// jpl::concurrent_queue.
+//
+// Each side owns its index, and keeps a cached copy of the other side's, which it only reloads when the queue looks
+// full (producer) or empty (consumer). So in the steady state, neither side touches the other's cache line, and
+// there are no read-modify-write operations at all.
+// A side that has to block sleeps on the other side's index, and sets a flag first, so that the other side only makes
+// the wake syscall when someone is actually sleeping.
+template<class T, ::uint32_t ring_buffer_size, bool use_optional = true>
+	requires(
+		// Indices are free running, and only wrap around correctly if the size divides 2^32
+		(::std::popcount(ring_buffer_size) == 1)
+		&& ::std::is_nothrow_move_constructible_v<T>
+		&& ::std::is_nothrow_destructible_v<T>
+	)
+class spsc_queue {
+	union slot {
+		T val;
+		slot() noexcept {}
+		~slot() noexcept {}
+	};
+
+	using optional_t = std::conditional_t<use_optional, ::std::optional<T>, T>;
+
+	alignas(hardware_destructive_interference_size) slot buffer[ring_buffer_size];
+	// Consumer's line
+	alignas(hardware_destructive_interference_size) ::std::atomic<::uint32_t> head{ 0 };
+	::uint32_t cached_tail{ 0 };
+	// Producer's line
+	alignas(hardware_destructive_interference_size) ::std::atomic<::uint32_t> tail{ 0 };
+	::uint32_t cached_head{ 0 };
+	// Rarely written, so both sides can keep this line in their caches
+	alignas(hardware_destructive_interference_size) ::std::atomic<bool> consumer_sleeping{ false };
+	::std::atomic<bool> producer_sleeping{ false };
+
+	// The fence orders the index store before the flag load, pairing with the fence in wait_for_change.
+	// The flag is cleared by whoever wakes the sleeper, so that until it gets to run, the rest of the operations
+	// don't make the syscall again.
+	[[gnu::always_inline]] static void wake(::std::atomic<::uint32_t>& index, ::std::atomic<bool>& sleeping) noexcept {
+		::std::atomic_thread_fence(::std::memory_order::seq_cst);
+		if (sleeping.load(::std::memory_order::relaxed) && sleeping.exchange(false, ::std::memory_order::relaxed)) [[unlikely]]
+			::jpl::detail::futex_wake(index);
+	}
+
+	// Blocks until index != seen, and returns its new value
+	static ::uint32_t wait_for_change(::std::atomic<::uint32_t>& index, ::uint32_t seen, ::std::atomic<bool>& sleeping) noexcept {
+		for (;;) {
+			sleeping.store(true, ::std::memory_order::relaxed);
+			::std::atomic_thread_fence(::std::memory_order::seq_cst);
+			const ::uint32_t current = index.load(::std::memory_order::acquire);
+			if (current != seen) {
+				sleeping.store(false, ::std::memory_order::relaxed);
+				return current;
+			}
+			::jpl::detail::futex_wait(index, seen);
+		}
+	}
+
+	template<class U>
+	[[gnu::always_inline]] void publish(U&& val, ::uint32_t t) noexcept {
+		::new (&buffer[t % ring_buffer_size].val) T{ static_cast<U&&>(val) };
+		tail.store(t + 1, ::std::memory_order::release);
+		wake(tail, consumer_sleeping);
+	}
+
+	template<class U>
+	[[gnu::always_inline]] void push_impl(U&& val) noexcept {
+		const ::uint32_t t = tail.load(::std::memory_order::relaxed);
+		if (t - cached_head == ring_buffer_size) [[unlikely]] {
+			cached_head = head.load(::std::memory_order::acquire);
+			while (t - cached_head == ring_buffer_size)
+				cached_head = wait_for_change(head, cached_head, producer_sleeping);
+		}
+		publish(static_cast<U&&>(val), t);
+	}
+
+	template<class U>
+	[[gnu::always_inline]] bool try_push_impl(U&& val) noexcept {
+		const ::uint32_t t = tail.load(::std::memory_order::relaxed);
+		if (t - cached_head == ring_buffer_size) {
+			cached_head = head.load(::std::memory_order::acquire);
+			if (t - cached_head == ring_buffer_size)
+				return false;
+		}
+		publish(static_cast<U&&>(val), t);
+		return true;
+	}
+
+	// Destroys the front element, which has already been moved from, and hands its slot back to the producer
+	[[gnu::always_inline]] void release(::uint32_t h) noexcept {
+		buffer[h % ring_buffer_size].val.~T();
+		head.store(h + 1, ::std::memory_order::release);
+		wake(head, producer_sleeping);
+	}
+
+	// Whether the consumer can see an element at h, reloading the producer's index only when the cached one says no
+	[[gnu::always_inline]] bool readable(::uint32_t h) noexcept {
+		if (h != cached_tail)
+			return true;
+		cached_tail = tail.load(::std::memory_order::acquire);
+		return h != cached_tail;
+	}
+
+	public:
+	spsc_queue() noexcept = default;
+	~spsc_queue() noexcept {
+		for (::uint32_t h = head.load(), t = tail.load(); h != t; ++h)
+			buffer[h % ring_buffer_size].val.~T();
+	}
+
+	spsc_queue(const spsc_queue&) = delete;
+	spsc_queue& operator=(const spsc_queue&) = delete;
+	spsc_queue(spsc_queue&&) = delete;
+	spsc_queue& operator=(spsc_queue&&) = delete;
+
+	// Consumer only
+
+	[[nodiscard]] T pop() noexcept {
+		const ::uint32_t h = head.load(::std::memory_order::relaxed);
+		while (!readable(h)) [[unlikely]]
+			cached_tail = wait_for_change(tail, h, consumer_sleeping);
+		T val{ static_cast<T&&>(buffer[h % ring_buffer_size].val) };
+		release(h);
+		return val;
+	}
+
+	[[nodiscard]] optional_t try_pop() noexcept {
+		const ::uint32_t h = head.load(::std::memory_order::relaxed);
+		if (!readable(h))
+			return {};
+		optional_t val{ static_cast<T&&>(buffer[h % ring_buffer_size].val) };
+		release(h);
+		return val;
+	}
+
+	[[nodiscard]] bool try_pop(T& out) noexcept requires(::std::is_nothrow_move_assignable_v<T>) {
+		const ::uint32_t h = head.load(::std::memory_order::relaxed);
+		if (!readable(h))
+			return false;
+		out = static_cast<T&&>(buffer[h % ring_buffer_size].val);
+		release(h);
+		return true;
+	}
+
+	// Producer only
+
+	void push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
+		push_impl(val);
+	}
+
+	void push(T&& val) noexcept {
+		push_impl(static_cast<T&&>(val));
+	}
+
+	bool try_push(const T& val) noexcept requires(::std::is_nothrow_copy_constructible_v<T>) {
+		return try_push_impl(val);
+	}
+
+	bool try_push(T&& val) noexcept {
+		return try_push_impl(static_cast<T&&>(val));
+	}
+};
+
+} // namespace jpl
+
+#endif // JPL_SPSC_QUEUE_HPP
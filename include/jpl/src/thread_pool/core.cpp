@@ -1,11 +1,18 @@
 #include <jpl/thread_pool.hpp>
 #include <jpl/concurrent_queue.hpp>
+#include <jpl/random.hpp>
 #include <jpl/vector.hpp>
+#include <jpl/bits/cpu_relax.hpp>
+#include <jpl/bits/futex.hpp>
+#include <jpl/bits/thread_pool/deque.hpp>
 #include <jpl/bits/thread_pool/io.hpp>
+#include <jpl/bits/thread_pool/overflow.hpp>
+#include <jpl/bits/topology.hpp>
 
+#include <algorithm>
+#include <memory>
 #include <thread>
-#include <queue>
-#include <mutex>
+#include <utility>
 
 #include <fmt/format.h>
 
@@ -14,44 +21,205 @@ namespace jpl::tp {
 using namespace ::std::chrono_literals;
 
 constexpr ::size_t n_timer_threads{ 2 };
+// Normal priority tasks enqueued from inside a worker go to its local deque, and spill over to the shared lane when it's full.
+constexpr ::uint32_t local_queue_size{ 256 };
+// Workers check the shared normal lane every nth task even when they have local work, so that tasks from outside
+// the pool don't starve.
+constexpr ::uint32_t global_queue_interval{ 61 };
+// How many spilled tasks a worker moves from a lane's overflow back into its ring buffer at once
+constexpr ::size_t overflow_batch{ 64 };
+// Nodes beyond this share queues with lower ones
+constexpr ::size_t max_nodes{ 64 };
+// Idle threads look for work after every n pause instructions while spinning
+constexpr ::uint32_t spin_batch{ 32 };
 
-inline thread_local task try_task;
-// TODO: the ring buffer size should be configurable, and there probably should be a dynamic overflow buffer for when it's full
-inline ::jpl::concurrent_queue<task, 2048, false> task_queue;
-inline ::jpl::concurrent_queue<task, 1024, false> ready_timed_events;
+#ifdef JPL_TP_QUEUE_STATS
+constexpr bool queue_stats_enabled{ true };
+#else
+constexpr bool queue_stats_enabled{ false };
+#endif
+
+inline conf config;
 inline ::std::atomic<bool> quit{ false };
-inline ::std::mutex timed_task_mutex;
-inline ::std::priority_queue<timed_task> timed_tasks;
+
+struct queued_task {
+	task t;
+	clock::time_point queued_at;
+
+	queued_task() noexcept = default;
+	queued_task(task&& t, clock::time_point queued_at) noexcept : t{ static_cast<task&&>(t) }, queued_at{ queued_at } {}
+};
+
+// Each lane is a ring buffer, plus an overflow list for tasks that didn't fit in it.
+// Pushing to the overflow never blocks, so tasks that enqueue tasks can't deadlock the pool.
+struct lane {
+	// TODO: the ring buffer size should be configurable
+	::jpl::concurrent_queue<queued_task, 2048, false, ::jpl::queue_wait::per_slot, queue_stats_enabled> queue;
+	detail::overflow_queue<queued_task> overflow;
+};
+
+// Each NUMA node has its own set of lanes, allocated on that node. Workers check their own node's lanes first.
+struct alignas(::jpl::detail::page_size) node_queues {
+	lane lanes[n_priorities];
+};
+
+// Only written by the owning worker, and summed up on read
+struct lane_counters {
+	::std::atomic<::uint64_t> n_tasks{ 0 };
+	::std::atomic<::uint64_t> total{ 0 };
+	::std::atomic<::uint64_t> max{ 0 };
+
+	void add(clock::duration wait) noexcept {
+		const ::uint64_t ns = ::std::chrono::duration_cast<::std::chrono::nanoseconds>(wait).count();
+		n_tasks.store(n_tasks.load(::std::memory_order::relaxed) + 1, ::std::memory_order::relaxed);
+		total.store(total.load(::std::memory_order::relaxed) + ns, ::std::memory_order::relaxed);
+		if (ns > max.load(::std::memory_order::relaxed))
+			max.store(ns, ::std::memory_order::relaxed);
+	}
+};
+
+// Spin, then yield, then park. With conf::idle.adaptive, the spin budget follows the gaps between going idle and
+// finding work again: about twice the recent average, and no spinning at all when work usually arrives later than
+// max_spin anyway.
+struct idle_state {
+	clock::duration spin_budget{ 0 };
+	clock::duration average_gap{ 0 };
+	clock::time_point idle_since;
+	// Only written by the owning thread, and summed up on read
+	::std::atomic<::uint64_t> spin_hits{ 0 };
+	::std::atomic<::uint64_t> yield_hits{ 0 };
+	::std::atomic<::uint64_t> parks{ 0 };
+
+	static void bump(::std::atomic<::uint64_t>& counter) noexcept {
+		counter.store(counter.load(::std::memory_order::relaxed) + 1, ::std::memory_order::relaxed);
+	}
+
+	void reset() noexcept {
+		spin_budget = config.idle.max_spin;
+		average_gap = clock::duration::zero();
+	}
+
+	void adapt(clock::duration gap) noexcept {
+		if (!config.idle.adaptive)
+			return;
+		average_gap += (gap - average_gap) / 8;
+		const clock::duration max_spin = config.idle.max_spin;
+		spin_budget = average_gap <= max_spin ? ::std::min(max_spin, 2 * average_gap) : clock::duration::zero();
+	}
+
+	// Returns true when try_get() found work, or false when it's time to park
+	template<class F>
+	bool spin(F&& try_get) noexcept {
+		idle_since = clock::now();
+		if (spin_budget > clock::duration::zero()) {
+			const clock::time_point deadline = idle_since + spin_budget;
+			do {
+				for (::uint32_t i = 0; i != spin_batch; ++i)
+					::jpl::detail::cpu_relax();
+				if (try_get()) {
+					bump(spin_hits);
+					adapt(clock::now() - idle_since);
+					return true;
+				}
+			} while (!quit.load(::std::memory_order::relaxed) && clock::now() < deadline);
+		}
+		for (::uint32_t i = 0; i != config.idle.n_yields; ++i) {
+			::std::this_thread::yield();
+			if (try_get()) {
+				bump(yield_hits);
+				adapt(clock::now() - idle_since);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// After waking up from a park
+	void parked() noexcept {
+		bump(parks);
+		adapt(clock::now() - idle_since);
+	}
+};
+
+struct alignas(hardware_destructive_interference_size) worker {
+	detail::work_stealing_deque<task, local_queue_size> local;
+	::jpl::pcg32 rng{ 0 };
+	::uint32_t tick{ 0 };
+	::uint32_t node{ 0 };
+	::uint32_t index{ 0 };
+	lane_counters latency[n_priorities];
+	idle_state idle;
+};
+
+inline thread_local task try_task;
+inline thread_local worker* this_worker{ nullptr };
+// Node 0's queues are static, so that tasks can be queued before init(). With multiple nodes, they're migrated
+// to node 0 when the pool starts, and the other nodes' queues are allocated on their own nodes.
+inline node_queues first_node_queues;
+inline node_queues* node_lanes[max_nodes]{ &first_node_queues };
+inline ::size_t n_queue_nodes{ 1 };
+// Node index of each CPU id, for finding the queues of threads outside the pool
+inline ::jpl::vector<::uint32_t> cpu_node;
+inline ::jpl::concurrent_queue<task, 1024, false, ::jpl::queue_wait::per_slot, queue_stats_enabled> ready_timed_events;
+inline idle_state timer_idle[n_timer_threads];
+inline detail::timer_wheel timers;
+// Every thread gets its own insertion buffer in the timer wheel, as long as there are enough of them
+inline ::std::atomic<::size_t> next_timer_shard{ 0 };
+inline thread_local const ::size_t timer_shard{ next_timer_shard.fetch_add(1, ::std::memory_order::relaxed) };
 inline ::jpl::vector<::std::thread> threads;
 inline ::jpl::vector<::std::thread, n_timer_threads> timer_threads;
+// Each worker is allocated on the node it's pinned to
+inline ::std::unique_ptr<worker*[]> workers;
+inline ::size_t n_workers{ 0 };
+// Idle workers park on idle_epoch. Producers only make the wake syscall when n_idle says someone might be parked.
+inline ::std::atomic<::uint32_t> idle_epoch{ 0 };
+inline ::std::atomic<::uint32_t> n_idle{ 0 };
+
+// Only one thread at a time processes IO completions and timers, whether it's in join() or waiting for a task_group
+inline ::std::atomic<bool> processing_events{ false };
 
 inline void process_timed() {
-	::std::lock_guard lock{ timed_task_mutex };
-	while (!timed_tasks.empty() && (timed_tasks.top().queue_at < clock::now())) {
-		ready_timed_events.push(static_cast<task&&>(const_cast<task&>(timed_tasks.top().t)));
-		timed_tasks.pop();
-	}
+	timers.process(clock::now(), [](task&& t) noexcept {
+		ready_timed_events.push(static_cast<task&&>(t));
+	});
+}
+
+inline bool detail::try_process_events(clock::duration max_wait, ::std::atomic<::uint32_t>* wake_word, ::uint32_t expected) {
+	if (processing_events.exchange(true, ::std::memory_order::acquire))
+		return false;
+	process_timed();
+	const clock::duration timeout = ::std::clamp<clock::duration>(timers.next_expiry() - clock::now(), 0ms, max_wait);
+	if (!wake_word || io_pending())
+		process_io(timeout);
+	else
+		::jpl::detail::futex_wait_for(*wake_word, expected, timeout);
+	process_timed();
+	processing_events.store(false, ::std::memory_order::release);
+	return true;
 }
 
 inline void join() noexcept {
-	clock::duration sleep_duration{ 5ms };
 	while (detail::pending_tasks && !quit) {
-		process_io(sleep_duration);
-		process_timed();
-		if (!timed_tasks.empty()) {
-			sleep_duration = ::std::min<clock::duration>(5ms, timed_tasks.top().queue_at - clock::now());
-		}
+		if (!detail::try_process_events(5ms))
+			::std::this_thread::sleep_for(1ms);
 	}
 }
 
 inline void cleanup() noexcept {
 	quit = true;
-	for (::size_t i = 0; i != threads.size(); ++i)
-		task_queue.push([]{});
+	idle_epoch.fetch_add(1);
+	::jpl::detail::futex_wake(idle_epoch);
 	for (::size_t i = 0; i != timer_threads.size(); ++i)
 		ready_timed_events.push([]{});
 	for (auto& t : threads) t.join();
 	for (auto& t : timer_threads) t.join();
+	for (::size_t i = 0; i != n_workers; ++i)
+		::jpl::detail::delete_on_node(workers[i]);
+	workers.reset();
+	n_workers = 0;
+	for (::size_t i = 1; i != n_queue_nodes; ++i)
+		::jpl::detail::delete_on_node(::std::exchange(node_lanes[i], nullptr));
+	n_queue_nodes = 1;
 	free_io();
 }
 
@@ -60,11 +228,193 @@ handle::~handle() {
 	cleanup();
 }
 
+inline void wake_worker() noexcept {
+	// Pairs with the n_idle increment in worker_loop, so that either the producer sees the idle worker,
+	// or the idle worker sees the new task when it re-checks the queues.
+	::std::atomic_thread_fence(::std::memory_order::seq_cst);
+	if (n_idle.load(::std::memory_order::relaxed)) {
+		idle_epoch.fetch_add(1, ::std::memory_order::release);
+		::jpl::detail::futex_wake(idle_epoch, 1);
+	}
+}
+
+inline void wake_workers(::size_t n) noexcept {
+	::std::atomic_thread_fence(::std::memory_order::seq_cst);
+	if (n_idle.load(::std::memory_order::relaxed)) {
+		idle_epoch.fetch_add(1, ::std::memory_order::release);
+		::jpl::detail::futex_wake(idle_epoch, n < INT_MAX ? int(n) : INT_MAX);
+	}
+}
+
+inline ::size_t home_node() noexcept {
+	if (worker* self = this_worker)
+		return self->node;
+	if (n_queue_nodes == 1)
+		return 0;
+	const ::uint32_t cpu = ::jpl::detail::current_cpu();
+	const ::uint32_t node = cpu < cpu_node.size() ? cpu_node[cpu] : ::jpl::detail::no_node;
+	return node < n_queue_nodes ? node : 0;
+}
+
+inline void enqueue_shared(task&& t, priority p, ::size_t node) noexcept {
+	lane& l = node_lanes[node]->lanes[::size_t(p)];
+	queued_task entry{ static_cast<task&&>(t), clock::now() };
+	// Once anything has spilled over, keep spilling until the overflow has been drained, so that tasks stay in FIFO order
+	if (l.overflow.size() || !l.queue.try_push(static_cast<queued_task&&>(entry))) [[unlikely]]
+		l.overflow.push(static_cast<queued_task&&>(entry));
+	wake_worker();
+}
+
+// Takes the oldest spilled task for the calling worker, and moves the following ones back into the ring buffer as long
+// as there's room, so that all workers can share them.
+inline bool try_pop_overflow(lane& l, queued_task& out) noexcept {
+	bool found = false;
+	const ::size_t n = l.overflow.try_drain(overflow_batch, [&](queued_task& entry) noexcept {
+		if (found)
+			return l.queue.try_push(static_cast<queued_task&&>(entry));
+		out = static_cast<queued_task&&>(entry);
+		found = true;
+		return true;
+	});
+	if (n > 1)
+		wake_workers(n - 1);
+	return found;
+}
+
+inline void enqueue_shared(task&& t, priority p) noexcept {
+	enqueue_shared(static_cast<task&&>(t), p, home_node());
+}
+
+// The calling thread's own node first, then the others
+inline bool try_pop_lane(priority p, task& out) noexcept {
+	queued_task entry;
+	const ::size_t home = home_node();
+	const ::size_t n_nodes = n_queue_nodes;
+	::size_t i = 0;
+	for (; i != n_nodes; ++i) {
+		lane& l = node_lanes[(home + i) % n_nodes]->lanes[::size_t(p)];
+		if (l.queue.try_pop(entry) || try_pop_overflow(l, entry))
+			break;
+	}
+	if (i == n_nodes)
+		return false;
+	if (worker* self = this_worker)
+		self->latency[::size_t(p)].add(clock::now() - entry.queued_at);
+	out = static_cast<task&&>(entry.t);
+	return true;
+}
+
+// Steals from workers on the same node first, and only then crosses over to other nodes
+inline bool try_steal(worker& self, task& out) noexcept {
+	const ::size_t start = self.rng() % n_workers;
+	const int n_passes = n_queue_nodes > 1 ? 2 : 1;
+	for (int pass = 0; pass != n_passes; ++pass) {
+		for (::size_t i = 0; i != n_workers; ++i) {
+			worker& victim = *workers[(start + i) % n_workers];
+			if (n_passes > 1 && (victim.node == self.node) != (pass == 0))
+				continue;
+			if (&victim != &self && victim.local.steal(out))
+				return true;
+		}
+	}
+	return false;
+}
+
+inline bool try_get_task(task& out) noexcept {
+	#ifndef JPL_TP_GLOBAL_QUEUE_ONLY
+	if (worker* self = this_worker) {
+		const ::uint32_t tick = ++self->tick;
+		// Every nth pick goes to a lower lane if it has work, no matter what's queued in the higher ones.
+		// Check the lowest lane first, so that it wins when the intervals line up.
+		for (::size_t p = n_priorities - 1; p != 0; --p) {
+			const ::uint32_t share = config.min_share[p];
+			if (share && (tick % share) == 0 && try_pop_lane(priority(p), out))
+				return true;
+		}
+		return try_pop_lane(priority::high, out)
+			|| ((tick % global_queue_interval) == 0 && try_pop_lane(priority::normal, out))
+			|| self->local.pop(out)
+			|| try_pop_lane(priority::normal, out)
+			|| try_steal(*self, out)
+			|| try_pop_lane(priority::low, out);
+	}
+	#endif
+	for (::size_t p = 0; p != n_priorities; ++p)
+		if (try_pop_lane(priority(p), out))
+			return true;
+	return false;
+}
+
+inline void run_task(task& t) {
+	t();
+	while (try_task) {
+		task next = static_cast<task&&>(try_task);
+		next();
+	}
+}
+
+inline bool detail::try_run_task() {
+	task t;
+	if (!try_get_task(t))
+		return false;
+	run_task(t);
+	return true;
+}
+
+inline bool detail::should_split() noexcept {
+	if (worker* self = this_worker)
+		return self->local.empty();
+	return n_idle.load(::std::memory_order::relaxed) != 0;
+}
+
+inline void worker_loop(::size_t idx) {
+	worker& self = *workers[idx];
+	self.rng.seed(idx);
+	self.index = ::uint32_t(idx);
+	this_worker = &self;
+	self.idle.reset();
+	try {
+		while (!quit) {
+			task t;
+			if (try_get_task(t) || self.idle.spin([&] { return try_get_task(t); })) {
+				run_task(t);
+				continue;
+			}
+			const ::uint32_t epoch = idle_epoch.load(::std::memory_order::acquire);
+			n_idle.fetch_add(1);
+			if (try_get_task(t)) {
+				n_idle.fetch_sub(1, ::std::memory_order::relaxed);
+				run_task(t);
+				continue;
+			}
+			if (!quit) {
+				::jpl::detail::futex_wait(idle_epoch, epoch);
+				self.idle.parked();
+			}
+			n_idle.fetch_sub(1, ::std::memory_order::relaxed);
+		}
+	} catch (const ::std::exception& err) {
+		// TODO: do something more reasonable here
+		::fmt::print("Caught unhandled exception! | {}\n", err.what());
+		quit = true;
+	} catch (...) {
+		::fmt::print("Caught unhandled exception of unknown type!\n");
+		quit = true;
+	}
+}
+
 template<auto& event_source>
-inline void task_loop() {
+inline void task_loop(::size_t idx) {
+	idle_state& idle = timer_idle[idx];
+	idle.reset();
 	try {
 		while (!quit) {
-			event_source.pop()();
+			task t;
+			if (!event_source.try_pop(t) && !idle.spin([&] { return event_source.try_pop(t); })) {
+				t = event_source.pop();
+				idle.parked();
+			}
+			t();
 			while (try_task) {
 				task t = static_cast<task&&>(try_task);
 				t();
@@ -80,13 +430,88 @@ inline void task_loop() {
 	}
 }
 
-inline handle init(::size_t n_threads) {
-	init_io();
-	n_threads = n_threads ? n_threads : ::std::thread::hardware_concurrency();
+// CPU of each worker, or an empty list when nothing should be pinned
+inline ::jpl::vector<::uint32_t> plan_placement(const ::jpl::detail::topology& topo, ::size_t n_threads) {
+	::jpl::vector<::uint32_t> plan;
+	switch (config.pinning) {
+		case affinity::none:
+			break;
+		case affinity::compact: {
+			::jpl::vector<::uint32_t> order;
+			for (::uint32_t node = 0; node != topo.n_nodes; ++node)
+				for (::uint32_t cpu : topo.cpus_of(node))
+					order.push_back(cpu);
+			for (::size_t i = 0; i != n_threads && !order.empty(); ++i)
+				plan.push_back(order[i % order.size()]);
+			break;
+		}
+		case affinity::scatter: {
+			// The CPUs of every node one after another, with node n's starting at node_begin[n]
+			::jpl::vector<::uint32_t> cpus;
+			::jpl::vector<::size_t> node_begin;
+			for (::uint32_t node = 0; node != topo.n_nodes; ++node) {
+				node_begin.push_back(cpus.size());
+				for (::uint32_t cpu : topo.cpus_of(node))
+					cpus.push_back(cpu);
+			}
+			node_begin.push_back(cpus.size());
+			for (::size_t i = 0; i != n_threads; ++i) {
+				const ::size_t node = i % topo.n_nodes;
+				const ::size_t n_cpus = node_begin[node + 1] - node_begin[node];
+				plan.push_back(cpus[node_begin[node] + (i / topo.n_nodes) % n_cpus]);
+			}
+			break;
+		}
+		case affinity::list:
+			for (::size_t i = 0; i != n_threads && !config.cpus.empty(); ++i)
+				plan.push_back(config.cpus[i % config.cpus.size()]);
+			break;
+	}
+	return plan;
+}
+
+inline handle init(const conf& new_config) {
+	config = new_config;
+	::size_t n_threads = config.n_threads ? config.n_threads : ::std::thread::hardware_concurrency();
+	init_io(config);
 	threads.reserve(n_threads);
+	workers = ::std::make_unique<worker*[]>(n_threads);
 	try {
-		for (::size_t i = 0; i != n_threads      ; ++i) threads      .emplace_back(task_loop<task_queue>);
-		for (::size_t i = 0; i != n_timer_threads; ++i) timer_threads.emplace_back(task_loop<ready_timed_events>);
+		// Without pinning, threads migrate freely between nodes, so there's no point in per-node queues
+		::jpl::detail::topology topo = config.pinning == affinity::none ? ::jpl::detail::topology{} : ::jpl::detail::read_topology();
+		const ::jpl::vector<::uint32_t> plan = plan_placement(topo, n_threads);
+		config.cpus = {}; // Only valid during init()
+		const auto node_of = [&](::uint32_t cpu) -> ::uint32_t {
+			const ::uint32_t node = cpu < topo.cpu_node.size() ? topo.cpu_node[cpu] : ::jpl::detail::no_node;
+			return node < max_nodes ? node : 0;
+		};
+
+		if (!plan.empty() && topo.n_nodes > 1) {
+			n_queue_nodes = ::std::min<::size_t>(topo.n_nodes, max_nodes);
+			::jpl::detail::bind_to_node(&first_node_queues, sizeof(first_node_queues), topo.node_ids[0]);
+			for (::size_t i = 1; i != n_queue_nodes; ++i)
+				node_lanes[i] = ::jpl::detail::new_on_node<node_queues>(topo.node_ids[i]);
+			cpu_node = static_cast<::jpl::vector<::uint32_t>&&>(topo.cpu_node);
+		}
+
+		::jpl::vector<::uint32_t> used_cpus;
+		for (; n_workers != n_threads; ++n_workers) {
+			const ::uint32_t node = plan.empty() ? 0 : node_of(plan[n_workers]);
+			workers[n_workers] = ::jpl::detail::new_on_node<worker>(topo.node_ids.empty() ? 0 : topo.node_ids[node]);
+			workers[n_workers]->node = node < n_queue_nodes ? node : 0;
+		}
+		for (::size_t i = 0; i != n_threads; ++i) {
+			threads.emplace_back(worker_loop, i);
+			if (!plan.empty()) {
+				::jpl::detail::set_affinity(threads.back(), { ::jpl::list, plan[i] });
+				used_cpus.push_back(plan[i]);
+			}
+		}
+		// Timer threads don't get a core of their own, but they're kept on the same CPUs as the workers
+		for (::size_t i = 0; i != n_timer_threads; ++i) {
+			timer_threads.emplace_back(task_loop<ready_timed_events>, i);
+			::jpl::detail::set_affinity(timer_threads.back(), used_cpus);
+		}
 	} catch (...) {
 		cleanup();
 		throw;
@@ -94,28 +519,140 @@ inline handle init(::size_t n_threads) {
 	return {};
 }
 
+inline handle init(::size_t n_threads) {
+	return init(conf{ .n_threads = n_threads });
+}
+
+inline ::uint64_t overflow_depth() noexcept {
+	::uint64_t depth = 0;
+	for (::size_t i = 0; i != n_queue_nodes; ++i)
+		for (lane& l : node_lanes[i]->lanes)
+			depth += l.overflow.size();
+	return depth;
+}
+
+inline idle_stats idle_counters() noexcept {
+	idle_stats stats{};
+	const auto add = [&](const idle_state& idle) {
+		stats.spin_hits  += idle.spin_hits .load(::std::memory_order::relaxed);
+		stats.yield_hits += idle.yield_hits.load(::std::memory_order::relaxed);
+		stats.parks      += idle.parks     .load(::std::memory_order::relaxed);
+	};
+	for (::size_t i = 0; i != n_workers; ++i)
+		add(workers[i]->idle);
+	for (const idle_state& idle : timer_idle)
+		add(idle);
+	return stats;
+}
+
+inline ::size_t n_threads() noexcept {
+	return n_workers;
+}
+
+inline ::size_t thread_index() noexcept {
+	worker* self = this_worker;
+	return self ? self->index : n_workers;
+}
+
+inline ::size_t n_nodes() noexcept {
+	return n_queue_nodes;
+}
+
+inline ::size_t current_node() noexcept {
+	return home_node();
+}
+
+inline latency_stats queue_latency(priority p) noexcept {
+	latency_stats stats{};
+	for (::size_t i = 0; i != n_workers; ++i) {
+		const lane_counters& counters = workers[i]->latency[::size_t(p)];
+		stats.n_tasks += counters.n_tasks.load(::std::memory_order::relaxed);
+		stats.total   += ::std::chrono::nanoseconds{ counters.total.load(::std::memory_order::relaxed) };
+		stats.max      = ::std::max<clock::duration>(stats.max, ::std::chrono::nanoseconds{ counters.max.load(::std::memory_order::relaxed) });
+	}
+	return stats;
+}
+
+#ifdef JPL_TP_QUEUE_STATS
+inline queue_stats lane_queue_stats(priority p) noexcept {
+	queue_stats stats{};
+	for (::size_t i = 0; i != n_queue_nodes; ++i) {
+		const queue_stats node_stats = node_lanes[i]->lanes[::size_t(p)].queue.stats();
+		stats.max_size        = ::std::max(stats.max_size, node_stats.max_size);
+		stats.blocked_pushes += node_stats.blocked_pushes;
+		stats.blocked_pops   += node_stats.blocked_pops;
+		stats.futex_waits    += node_stats.futex_waits;
+		stats.wait_time      += node_stats.wait_time;
+	}
+	return stats;
+}
+
+inline queue_stats timer_queue_stats() noexcept {
+	return ready_timed_events.stats();
+}
+#endif
+
+inline void enqueue(priority p, task&& t) noexcept {
+	#ifndef JPL_TP_GLOBAL_QUEUE_ONLY
+	if (worker* self = this_worker; p == priority::normal && self && self->local.push(static_cast<task&&>(t))) {
+		wake_worker();
+		return;
+	}
+	#endif
+	enqueue_shared(static_cast<task&&>(t), p);
+}
+
 inline void enqueue(task&& t) noexcept {
-	task_queue.push(static_cast<task&&>(t));
+	enqueue(priority::normal, static_cast<task&&>(t));
+}
+
+inline void enqueue_on(::size_t node, priority p, task&& t) noexcept {
+	enqueue_shared(static_cast<task&&>(t), p, node % n_queue_nodes);
 }
 
-try_yield::try_yield() noexcept : resumed{ task_queue.try_pop(try_task) } {}
+inline void enqueue_on(::size_t node, task&& t) noexcept {
+	enqueue_on(node, priority::normal, static_cast<task&&>(t));
+}
+
+// Coroutines that concurrent_queue::async_pop and async_push parked are resumed by the push or pop that served them,
+// so they go to the local deque of that worker, like any task it spawns
+inline void detail::resume_on_pool(::std::coroutine_handle<> handle) noexcept {
+	enqueue(handle);
+}
+
+try_yield::try_yield(priority lane) noexcept : resumed{ try_get_task(try_task) }, lane{ lane } {}
 
+// Yielded coroutines go to the shared lanes, so that they're resumed after the work that's already queued,
+// instead of immediately by the same worker.
 void try_yield::await_suspend(::std::coroutine_handle<> handle) noexcept {
-	task_queue.push(handle);
+	enqueue_shared(handle, lane);
 }
 
 void yield::await_suspend(::std::coroutine_handle<> handle) noexcept {
-	task_queue.push(handle);
+	enqueue_shared(handle, lane);
 }
 
 void sleep_for::await_suspend(::std::coroutine_handle<> handle) noexcept {
-	::std::lock_guard lock{ timed_task_mutex };
-	timed_tasks.emplace(timed_task{ handle, clock::now() + duration });
+	node.t = handle;
+	timers.schedule(&node, clock::now() + duration, timer_shard);
 }
 
 void sleep_until::await_suspend(::std::coroutine_handle<> handle) noexcept {
-	::std::lock_guard lock{ timed_task_mutex };
-	timed_tasks.emplace(timed_task{ handle, ts });
+	node.t = handle;
+	timers.schedule(&node, ts, timer_shard);
+}
+
+inline timer enqueue_at(clock::time_point when, task&& t) {
+	detail::timer_node* node = new detail::timer_node{};
+	node->t = static_cast<task&&>(t);
+	// One reference for the wheel, one for the handle
+	node->refs.store(2, ::std::memory_order::relaxed);
+	timers.schedule(node, when, timer_shard);
+	return timer{ node };
+}
+
+inline bool timer::cancel() noexcept {
+	return node && timers.cancel(node);
 }
 
 } // namespace jpl::tp
@@ -1,18 +1,27 @@
 #include <chrono>
+#include <jpl/concurrent_queue.hpp>
 #include <jpl/thread_pool.hpp>
 #include <jpl/vector.hpp>
+#include <jpl/bits/allocator.hpp>
 #include <jpl/bits/thread_pool/io.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <span>
 #include <stdexcept>
+#include <system_error>
 #include <thread>
 #include <mutex>
 
 #ifdef __linux__
 #include <linux/io_uring.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <time.h>
 #else
@@ -53,11 +62,24 @@ struct request_t {
 unsigned sq_entries;
 unsigned pending_io = 0;
 
-read_file_awaiter::read_file_awaiter(int fd) : fd{ fd } {
-	struct ::stat st;
-	::fstat(fd, &st); // TODO: check return value
-	buffer.resize(st.st_size);
-}
+// Free lists of buffer and file slot indices, which read_file and friends co_await on when they run out
+using index_queue = ::jpl::concurrent_queue<::uint32_t, ::jpl::dynamic_size, false, ::jpl::queue_wait::per_slot, false, true>;
+
+// Buffers for read_fixed, in a single allocation, and the indices of the ones that aren't leased
+char* io_buffer_memory;
+::uint32_t io_buffer_count;
+::uint32_t io_buffer_bytes;
+bool io_buffers_registered;
+::std::unique_ptr<index_queue> free_io_buffers;
+
+// Slots of the registered file table that read_file can open a file into
+::uint32_t io_file_count;
+bool io_files_registered;
+::std::unique_ptr<index_queue> free_io_files;
+
+// How transfer_chunks splits up big reads, from conf
+::uint32_t io_chunk_size;
+::uint32_t io_chunks_in_flight;
 
 struct empty_promise {
 	struct promise_type {
@@ -69,57 +91,625 @@ struct empty_promise {
 	};
 };
 
-void fill_sqe(::std::coroutine_handle<> handle, unsigned turn, jpl::vector<char>& buffer) {
+// The fields of an SQE that are set here. They're given with designated initializers of this instead of
+// ::io_uring_sqe itself, since most of its fields are in anonymous unions, so those would always skip some, which
+// -Wextra warns about.
+struct sqe_fields {
+	::uint8_t opcode;
+	::uint8_t flags{ 0 };
+	int fd{ 0 };
+	::uint64_t off{ 0 };
+	::uint64_t addr2{ 0 };      // Shares off's union, so only one of them can be set
+	::uint64_t addr{ 0 };
+	::uint32_t len{ 0 };
+	::uint32_t op_flags{ 0 };   // open_flags, fsync_flags and the like, which share a union
+	::uint16_t buf_index{ 0 };
+	::uint32_t file_index{ 0 };
+};
+
+inline ::io_uring_sqe make_sqe(const sqe_fields& fields) noexcept {
+	::io_uring_sqe sqe{};
+	sqe.opcode = fields.opcode;
+	sqe.flags = fields.flags;
+	sqe.fd = fields.fd;
+	sqe.off = fields.addr2 ? fields.addr2 : fields.off;
+	sqe.addr = fields.addr;
+	sqe.len = fields.len;
+	sqe.open_flags = fields.op_flags;
+	sqe.buf_index = fields.buf_index;
+	sqe.file_index = fields.file_index;
+	return sqe;
+}
+
+void fill_sqe(unsigned turn, const ::io_uring_sqe& sqe, detail::io_request& request) {
 	unsigned idx = turn & sq_mask;
-	::io_uring_sqe& sqe{ sqes[idx] };
-	sqe.opcode = IORING_OP_READ;
-	sqe.flags = 0;
-	sqe.ioprio = 0;
-	sqe.fd = fd;
-	sqe.off = 0;
-	sqe.addr = reinterpret_cast<::uint64_t>(buffer.data());
-	sqe.len = buffer.size();
-	sqe.rw_flags = 0;
-	::memcpy(&sqe.user_data, &handle, sizeof(handle));
-	sqe.__pad2[0] = sqe.__pad2[1] = sqe.__pad2[2] = 0;
+	::memcpy(&sqes[idx], &sqe, sizeof(::io_uring_sqe));
+	sqes[idx].user_data = reinterpret_cast<::uint64_t>(&request);
 
 	detail::pending_tasks++;
 	sqe_sync[idx] = turn + 1;
 }
 
-inline empty_promise get_turn_wait(::std::coroutine_handle<> handle, unsigned turn, jpl::vector<char>& buffer) noexcept {
-	while ((turn - sq_head_local) >= (sq_entries - 1)) [[unlikely]] {
-		request_t request = turn_request;
-		if (request.active && (turn == request.turn)) {
+// Whether add_timeout_event took turn over, because the SQ was full. Has to be checked after reading sq_head_local,
+// since the takeover happens before the head moves on, so a turn that looks free may still have been taken.
+inline bool turn_taken_over(unsigned turn) noexcept {
+	const request_t request = turn_request;
+	return request.active && request.turn == turn;
+}
+
+// Takes sqe by value, since it may have to outlive the caller's copy while it waits. It always sleeps rather than spins,
+// since it may be running on a timer thread, and process_io can only move the SQ on while those keep up.
+inline empty_promise get_turn_wait(unsigned turn, ::io_uring_sqe sqe, detail::io_request& request) noexcept {
+	for (;;) {
+		const unsigned ahead = turn - sq_head_local;
+		if (turn_taken_over(turn)) {
 			turn = sq_tail_local++;
 			turn_request = request_t{ 0, false };
+			continue;
 		}
-		if ((turn - sq_head_local) > sq_entries)
-			co_await jpl::tp::sleep_for{ 5ms };
+		if (ahead < (sq_entries - 1))
+			break;
+		co_await jpl::tp::sleep_for{ 5ms };
 	}
-	fill_sqe(handle, turn, buffer);
+	fill_sqe(turn, sqe, request);
 }
 
-void read_file_awaiter::await_suspend(::std::coroutine_handle<> handle) {
+// Queues sqe with its user_data pointing to request, whose handle has to be set already. The CQE's result goes to
+// request, and the coroutine is resumed once it arrives.
+void submit(const ::io_uring_sqe& sqe, detail::io_request& request) {
 	unsigned turn = sq_tail_local.fetch_add(1, ::std::memory_order::acquire);
-	if ((turn - sq_head_local) >= (sq_entries - 1)) [[unlikely]]
-		get_turn_wait(handle, turn, buffer);
+	if ((turn - sq_head_local) >= (sq_entries - 1) || turn_taken_over(turn)) [[unlikely]]
+		get_turn_wait(turn, sqe, request);
 	else
-		fill_sqe(handle, turn, buffer);
+		fill_sqe(turn, sqe, request);
+}
+
+// Takes n consecutive turns, but only if the SQ has room for all of them. That way add_timeout_event never takes one
+// of them over, which would break up a linked chain.
+inline bool try_take_turns(unsigned n, unsigned& turn) noexcept {
+	turn = sq_tail_local.load(::std::memory_order::acquire);
+	do {
+		if ((turn + n - sq_head_local) >= (sq_entries - 1))
+			return false;
+	} while (!sq_tail_local.compare_exchange_weak(turn, turn + n));
+	return true;
+}
+
+inline empty_promise submit_chain_wait(::std::span<const ::io_uring_sqe> chain, detail::io_request* requests) noexcept {
+	unsigned turn;
+	while (!try_take_turns(unsigned(chain.size()), turn))
+		co_await jpl::tp::sleep_for{ 5ms };
+	for (unsigned i = 0; i != chain.size(); ++i)
+		fill_sqe(turn + i, chain[i], requests[i]);
+}
+
+// Queues linked SQEs next to each other, so that process_io always submits them together. The handle of the first
+// request has to be set already, and it's resumed once all of them have completed.
+void submit_chain(::std::span<const ::io_uring_sqe> chain, detail::io_request* requests) {
+	requests[0].pending = unsigned(chain.size());
+	for (unsigned i = 1; i != chain.size(); ++i)
+		requests[i].first = &requests[0];
+	unsigned turn;
+	if (!try_take_turns(unsigned(chain.size()), turn)) [[unlikely]] {
+		submit_chain_wait(chain, requests);
+		return;
+	}
+	for (unsigned i = 0; i != chain.size(); ++i)
+		fill_sqe(turn + i, chain[i], requests[i]);
+}
+
+// Submits a single SQE, and gives its result
+struct io_awaiter {
+	::io_uring_sqe sqe;
+	detail::io_request request{};
+	static constexpr bool await_ready() noexcept { return false; }
+	void await_suspend(::std::coroutine_handle<> handle) {
+		request.handle = handle;
+		submit(sqe, request);
+	}
+	::int32_t await_resume() const noexcept { return request.result; }
+};
+
+// Submits SQEs next to each other, linked or not, and gives the result of each in requests, once all have completed.
+// They have to fit in the SQ, so at most io_chunks_in_flight of them, or a short chain.
+struct io_batch_awaiter {
+	::std::span<const ::io_uring_sqe> sqes;
+	detail::io_request* requests;
+	static constexpr bool await_ready() noexcept { return false; }
+	void await_suspend(::std::coroutine_handle<> handle) {
+		requests[0].handle = handle;
+		submit_chain(sqes, requests);
+	}
+	static constexpr void await_resume() noexcept {}
+};
+
+// Submits n SQEs, which should be linked, and gives the result of each in requests
+template<unsigned n>
+struct io_chain_awaiter {
+	::io_uring_sqe sqes[n];
+	detail::io_request requests[n]{};
+	static constexpr bool await_ready() noexcept { return false; }
+	void await_suspend(::std::coroutine_handle<> handle) {
+		requests[0].handle = handle;
+		submit_chain(sqes, requests);
+	}
+	static constexpr void await_resume() noexcept {}
+};
+
+[[noreturn]] inline void throw_io_error(::int32_t result, const char* what) {
+	throw ::std::system_error{ -result, ::std::generic_category(), what };
+}
+
+namespace detail {
+// Byte range [begin, end) of the data given to transfer_chunks that's still to be transferred. At namespace scope,
+// since the coroutine frame holds them, and its type has linkage.
+struct io_chunk {
+	::uint64_t begin;
+	::uint64_t end;
+};
+} // namespace detail
+
+// Reads or writes size bytes at data, with sqe as the template for the opcode, file and starting offset. The range
+// is split into io_chunk_size chunks, submitted io_chunks_in_flight at a time. A chunk that comes back short is
+// resubmitted for the rest in the next batch, and one that comes back with 0 marks the end of the file.
+// An offset of -1 means the file position, which only moves as each chunk completes, so then the chunks of a batch are
+// linked to go one after another. A short one cancels the rest, which are resubmitted as they were.
+// Gives the number of bytes up to where the file ended, or the first error as a negative errno. Never throws, so that
+// the caller can close the file either way.
+lazy<::int64_t> transfer_chunks(::io_uring_sqe sqe, char* data, ::uint64_t size) noexcept {
+	::jpl::vector<detail::io_chunk> chunks;
+	::jpl::vector<::io_uring_sqe> sqes;
+	::jpl::vector<detail::io_request> requests;
+	try {
+		chunks.reserve(io_chunks_in_flight);
+		sqes.reserve(io_chunks_in_flight);
+		requests.reserve(io_chunks_in_flight);
+	} catch (...) {
+		co_return -ENOMEM;
+	}
+
+	const bool sequential = sqe.off == ~::uint64_t(0);
+	::uint64_t next = 0;
+	::uint64_t end = size;
+	::int32_t error = 0;
+	for (;;) {
+		// Short chunks carry over, and new ones fill the batch up
+		while (chunks.size() != io_chunks_in_flight && next < end) {
+			const ::uint64_t len = ::std::min<::uint64_t>(io_chunk_size, end - next);
+			chunks.push_back({ next, next + len });
+			next += len;
+		}
+		if (chunks.empty())
+			break;
+
+		sqes.clear();
+		requests.clear();
+		for (const detail::io_chunk& c : chunks) {
+			::io_uring_sqe& s = sqes.emplace_back(sqe);
+			s.off = sequential ? sqe.off : sqe.off + c.begin;
+			s.addr = reinterpret_cast<::uint64_t>(data + c.begin);
+			s.len = ::uint32_t(c.end - c.begin);
+			requests.emplace_back();
+		}
+		if (sequential)
+			for (::uint32_t i = 0; i + 1 < sqes.size(); ++i)
+				sqes[i].flags |= IOSQE_IO_LINK;
+		co_await io_batch_awaiter{ sqes, requests.data() };
+
+		::uint32_t n_left = 0;
+		for (::uint32_t i = 0; i != chunks.size(); ++i) {
+			detail::io_chunk c = chunks[i];
+			const ::int32_t result = requests[i].result;
+			if (sequential && result == -ECANCELED) {
+				chunks[n_left++] = c;
+				continue;
+			}
+			if (result < 0) {
+				error = error ? error : result;
+				continue;
+			}
+			if (result == 0) {
+				end = ::std::min(end, c.begin);
+				continue;
+			}
+			c.begin += ::uint32_t(result);
+			if (c.begin < c.end && c.begin < end)
+				chunks[n_left++] = c;
+		}
+		chunks.resize(n_left);
+		if (error)
+			co_return error;
+	}
+	co_return ::int64_t(end);
+}
+
+// For writes, which only read from data
+inline lazy<::int64_t> transfer_chunks(::io_uring_sqe sqe, const char* data, ::uint64_t size) noexcept {
+	assert(sqe.opcode == IORING_OP_WRITE);
+	return transfer_chunks(sqe, const_cast<char*>(data), size);
+}
+
+// Gives a read_file slot back when the file is done with, whether it ever got opened or not
+struct io_file_slot {
+	bool leased;
+	::uint32_t index;
+	~io_file_slot() {
+		if (leased)
+			free_io_files->push(index);
+	}
+};
+
+lazy<::jpl::vector<char>> read_file(const char* file_path) {
+	// With the file table, the file is opened into a slot of it as a direct descriptor, which READ and CLOSE refer to
+	// with its index, and which doesn't count against RLIMIT_NOFILE
+	const bool direct = io_files_registered;
+	io_file_slot slot{ false, 0 };
+	// Not in a conditional expression, since GCC evaluates a co_await in one regardless of the condition
+	if (direct) {
+		slot.index = co_await free_io_files->async_pop();
+		slot.leased = true;
+	}
+	struct ::statx st;
+
+	// statx goes by the path, since it can't take a direct descriptor. The hard link lets it run even if the open
+	// fails, so that the chain completes either way.
+	io_chain_awaiter<2> open{ {
+		make_sqe({
+			.opcode = IORING_OP_OPENAT,
+			.flags = IOSQE_IO_HARDLINK,
+			.fd = AT_FDCWD,
+			.addr = reinterpret_cast<::uint64_t>(file_path),
+			// Direct descriptors aren't in the process's table, so O_CLOEXEC doesn't apply, and is rejected
+			.op_flags = ::uint32_t(direct ? O_RDONLY : O_RDONLY | O_CLOEXEC),
+			.file_index = direct ? slot.index + 1 : 0,
+		}),
+		make_sqe({
+			.opcode = IORING_OP_STATX,
+			.fd = AT_FDCWD,
+			.addr2 = reinterpret_cast<::uint64_t>(&st),
+			.addr = reinterpret_cast<::uint64_t>(file_path),
+			.len = STATX_SIZE,
+		}),
+	} };
+	co_await open;
+	if (open.requests[0].result < 0)
+		throw_io_error(open.requests[0].result, "jpl::tp::read_file: open");
+	const int file = direct ? int(slot.index) : open.requests[0].result;
+	const ::io_uring_sqe close_sqe = make_sqe({
+		.opcode = IORING_OP_CLOSE,
+		.fd = direct ? 0 : file,
+		.file_index = direct ? slot.index + 1 : 0,
+	});
+	if (open.requests[1].result < 0) {
+		co_await io_awaiter{ close_sqe };
+		throw_io_error(open.requests[1].result, "jpl::tp::read_file: statx");
+	}
+
+	::jpl::vector<char> buffer;
+	buffer.resize(st.stx_size);
+	const ::io_uring_sqe read_sqe = make_sqe({
+		.opcode = IORING_OP_READ,
+		.flags = ::uint8_t(direct ? IOSQE_FIXED_FILE : 0),
+		.fd = file,
+		.off = 0,
+	});
+	if (buffer.size() > io_chunk_size) {
+		const ::int64_t result = co_await transfer_chunks(read_sqe, buffer.data(), buffer.size());
+		co_await io_awaiter{ close_sqe };
+		if (result < 0)
+			throw_io_error(::int32_t(result), "jpl::tp::read_file: read");
+		buffer.resize(::size_t(result));
+		co_return static_cast<::jpl::vector<char>&&>(buffer);
+	}
+
+	// Hard linked, so that the file gets closed even if the read fails. It's within a single read's limit, and a
+	// regular file only reads short at its end, so there's nothing to resubmit.
+	io_chain_awaiter<2> read{ {
+		make_sqe({
+			.opcode = IORING_OP_READ,
+			.flags = ::uint8_t(IOSQE_IO_HARDLINK | (direct ? IOSQE_FIXED_FILE : 0)),
+			.fd = file,
+			.off = 0,
+			.addr = reinterpret_cast<::uint64_t>(buffer.data()),
+			.len = ::uint32_t(buffer.size()),
+		}),
+		close_sqe,
+	} };
+	co_await read;
+	if (read.requests[0].result < 0)
+		throw_io_error(read.requests[0].result, "jpl::tp::read_file: read");
+	// The file may have shrunk since statx
+	buffer.resize(::size_t(read.requests[0].result));
+	co_return static_cast<::jpl::vector<char>&&>(buffer);
+}
+
+io_buffer::~io_buffer() {
+	if (index != UINT32_MAX)
+		free_io_buffers->push(index);
 }
 
-read_file_awaiter read_file(const char* file_path) {
-	int file_fd = ::open(file_path, O_RDONLY);
-	if (file_fd < 0)
-		throw ::std::runtime_error("Unable to open file");
-	return file_fd;
+lazy<io_buffer> read_fixed(int fd, ::uint64_t offset, ::uint32_t length) {
+	if (!io_buffer_count)
+		throw ::std::logic_error{ "jpl::tp::read_fixed needs conf::io_buffers" };
+	const ::uint32_t index = co_await free_io_buffers->async_pop();
+	char* const memory = io_buffer_memory + ::size_t(index) * io_buffer_bytes;
+	io_buffer buffer{ index, { memory, 0 } };
+
+	const ::int32_t result = co_await io_awaiter{ make_sqe({
+		.opcode = ::uint8_t(io_buffers_registered ? IORING_OP_READ_FIXED : IORING_OP_READ),
+		.fd = fd,
+		.off = offset,
+		.addr = reinterpret_cast<::uint64_t>(memory),
+		.len = length < io_buffer_bytes ? length : io_buffer_bytes,
+		.buf_index = ::uint16_t(index),
+	}) };
+	if (result < 0)
+		throw ::std::system_error{ -result, ::std::generic_category(), "jpl::tp::read_fixed" };
+	buffer.bytes = { memory, ::size_t(result) };
+	co_return static_cast<io_buffer&&>(buffer);
 }
 
-void init_io() {
+// Writes size bytes at data, with sqe as the template for the opcode, file and offset, then syncs the file if asked to.
+// Gives 0, or the first error as a negative errno, and -EIO if a write stops making progress. Never throws, like
+// transfer_chunks.
+lazy<::int32_t> write_all(::io_uring_sqe sqe, const char* data, ::uint64_t size, io_sync sync) noexcept {
+	const ::io_uring_sqe fsync_sqe = make_sqe({
+		.opcode = IORING_OP_FSYNC,
+		.flags = ::uint8_t(sqe.flags & IOSQE_FIXED_FILE),
+		.fd = sqe.fd,
+		.op_flags = sync == io_sync::data ? IORING_FSYNC_DATASYNC : 0u,
+	});
+	::uint64_t written = 0;
+	if (sync != io_sync::none && size <= io_chunk_size) {
+		// A short write breaks the link, and cancels the sync, which then goes in on its own after the rest
+		io_chain_awaiter<2> chain{ { sqe, fsync_sqe } };
+		chain.sqes[0].flags |= IOSQE_IO_LINK;
+		chain.sqes[0].addr = reinterpret_cast<::uint64_t>(data);
+		chain.sqes[0].len = ::uint32_t(size);
+		co_await chain;
+		if (chain.requests[0].result < 0)
+			co_return chain.requests[0].result;
+		if (::uint64_t(chain.requests[0].result) == size)
+			co_return ::std::min(chain.requests[1].result, 0);
+		written = ::uint64_t(chain.requests[0].result);
+	}
+	if (written != size) {
+		if (sqe.off != ~::uint64_t(0))
+			sqe.off += written;
+		const ::int64_t result = co_await transfer_chunks(sqe, data + written, size - written);
+		if (result < 0)
+			co_return ::int32_t(result);
+		if (::uint64_t(result) != size - written)
+			co_return -EIO;
+	}
+	if (sync == io_sync::none)
+		co_return 0;
+	const ::int32_t synced = co_await io_awaiter{ fsync_sqe };
+	co_return ::std::min(synced, 0);
+}
+
+lazy<void> write_file(const char* file_path, ::std::span<const ::std::byte> data, write_options options) {
+	if (options.direct && ((reinterpret_cast<::uintptr_t>(data.data()) | data.size()) % direct_io_alignment))
+		throw ::std::invalid_argument{ "jpl::tp::write_file: O_DIRECT data has to be aligned to direct_io_alignment" };
+	const char* bytes = reinterpret_cast<const char*>(data.data());
+
+	// Like in read_file, with the file table the file is a direct descriptor in one of its slots
+	const bool in_table = io_files_registered;
+	io_file_slot slot{ false, 0 };
+	if (in_table) {
+		slot.index = co_await free_io_files->async_pop();
+		slot.leased = true;
+	}
+	int open_flags = O_WRONLY | O_CREAT | (options.append ? O_APPEND : O_TRUNC) | (options.direct ? O_DIRECT : 0);
+	const ::io_uring_sqe close_sqe = make_sqe({
+		.opcode = IORING_OP_CLOSE,
+		.fd = 0,
+		.file_index = slot.index + 1,
+	});
+	::io_uring_sqe write_sqe = make_sqe({
+		.opcode = IORING_OP_WRITE,
+		.flags = IOSQE_FIXED_FILE,
+		.fd = int(slot.index),
+		// The file position of an O_APPEND file is always its end
+		.off = options.append ? ~::uint64_t(0) : 0,
+	});
+	::uint64_t written = 0;
+
+	if (in_table && data.size() <= io_chunk_size) {
+		// If the open fails, the link cancels the rest. After that everything is hard linked, so that the file gets
+		// closed whatever happens, and a sync runs even after a short write, but then just syncs less.
+		::io_uring_sqe sqes[4] = {
+			make_sqe({
+				.opcode = IORING_OP_OPENAT,
+				.flags = IOSQE_IO_LINK,
+				.fd = AT_FDCWD,
+				.addr = reinterpret_cast<::uint64_t>(file_path),
+				.len = options.mode,
+				.op_flags = ::uint32_t(open_flags),
+				.file_index = slot.index + 1,
+			}),
+			write_sqe,
+			make_sqe({
+				.opcode = IORING_OP_FSYNC,
+				.flags = IOSQE_IO_HARDLINK | IOSQE_FIXED_FILE,
+				.fd = int(slot.index),
+				.op_flags = options.sync == io_sync::data ? IORING_FSYNC_DATASYNC : 0u,
+			}),
+			close_sqe,
+		};
+		sqes[1].flags |= IOSQE_IO_HARDLINK;
+		sqes[1].addr = reinterpret_cast<::uint64_t>(bytes);
+		sqes[1].len = ::uint32_t(data.size());
+		const bool sync = options.sync != io_sync::none;
+		if (!sync)
+			sqes[2] = close_sqe;
+		detail::io_request requests[4]{};
+		co_await io_batch_awaiter{ { sqes, sync ? 4u : 3u }, requests };
+		const ::int32_t opened = requests[0].result, result = requests[1].result;
+		const ::int32_t synced = sync ? requests[2].result : 0, closed = requests[sync ? 3 : 2].result;
+		if (opened < 0)
+			throw_io_error(opened, "jpl::tp::write_file: open");
+		if (result < 0)
+			throw_io_error(result, "jpl::tp::write_file: write");
+		if (::uint64_t(result) == data.size()) {
+			if (synced < 0)
+				throw_io_error(synced, "jpl::tp::write_file: sync");
+			if (closed < 0)
+				throw_io_error(closed, "jpl::tp::write_file: close");
+			co_return;
+		}
+		// A short write, so the rest goes through a second open, which mustn't truncate what's already written
+		written = ::uint64_t(result);
+		open_flags &= ~O_TRUNC;
+		if (!options.append)
+			write_sqe.off = written;
+	}
+
+	const ::int32_t opened = co_await io_awaiter{ make_sqe({
+		.opcode = IORING_OP_OPENAT,
+		.fd = AT_FDCWD,
+		.addr = reinterpret_cast<::uint64_t>(file_path),
+		.len = options.mode,
+		// Direct descriptors aren't in the process's table, so O_CLOEXEC doesn't apply, and is rejected
+		.op_flags = ::uint32_t(in_table ? open_flags : open_flags | O_CLOEXEC),
+		.file_index = in_table ? slot.index + 1 : 0,
+	}) };
+	if (opened < 0)
+		throw_io_error(opened, "jpl::tp::write_file: open");
+	::io_uring_sqe close_fd = close_sqe;
+	if (!in_table) {
+		write_sqe.flags = 0;
+		write_sqe.fd = opened;
+		close_fd.fd = opened;
+		close_fd.file_index = 0;
+	}
+	const ::int32_t result = co_await write_all(write_sqe, bytes + written, data.size() - written, options.sync);
+	const ::int32_t closed = co_await io_awaiter{ close_fd };
+	if (result < 0)
+		throw_io_error(result, "jpl::tp::write_file: write");
+	if (closed < 0)
+		throw_io_error(closed, "jpl::tp::write_file: close");
+}
+
+lazy<void> write_at(int fd, ::uint64_t offset, ::std::span<const ::std::byte> data, io_sync sync) {
+	const ::int32_t result = co_await write_all(make_sqe({
+		.opcode = IORING_OP_WRITE,
+		.fd = fd,
+		.off = offset,
+	}), reinterpret_cast<const char*>(data.data()), data.size(), sync);
+	if (result < 0)
+		throw_io_error(result, "jpl::tp::write_at");
+}
+
+lazy<void> append(int fd, ::std::span<const ::std::byte> data, io_sync sync) {
+	const ::int32_t result = co_await write_all(make_sqe({
+		.opcode = IORING_OP_WRITE,
+		.fd = fd,
+		.off = ~::uint64_t(0),
+	}), reinterpret_cast<const char*>(data.data()), data.size(), sync);
+	if (result < 0)
+		throw_io_error(result, "jpl::tp::append");
+}
+
+void read_at::await_suspend(::std::coroutine_handle<> handle) {
+	request.handle = handle;
+	submit(make_sqe({
+		.opcode = IORING_OP_READ,
+		.fd = fd,
+		.off = offset,
+		.addr = reinterpret_cast<::uint64_t>(buffer.data()),
+		.len = ::uint32_t(::std::min<::size_t>(buffer.size(), 0x7ffff000)),
+	}), request);
+}
+
+::size_t read_at::await_resume() const {
+	if (request.result < 0)
+		throw_io_error(request.result, "jpl::tp::read_at");
+	return ::size_t(request.result);
+}
+
+void readv_at::await_suspend(::std::coroutine_handle<> handle) {
+	request.handle = handle;
+	submit(make_sqe({
+		.opcode = IORING_OP_READV,
+		.fd = fd,
+		.off = offset,
+		.addr = reinterpret_cast<::uint64_t>(buffers.data()),
+		.len = ::uint32_t(buffers.size()),
+	}), request);
+}
+
+::size_t readv_at::await_resume() const {
+	if (request.result < 0)
+		throw_io_error(request.result, "jpl::tp::readv_at");
+	return ::size_t(request.result);
+}
+
+// Done before setting up the ring, so that the only thing left to fail afterwards is registering
+void alloc_io_buffers(::uint32_t n_buffers, ::uint32_t buffer_size) {
+	io_buffer_count = buffer_size ? (n_buffers < UIO_MAXIOV ? n_buffers : UIO_MAXIOV) : 0;
+	io_buffer_bytes = buffer_size;
+	io_buffers_registered = false;
+	if (!io_buffer_count)
+		return;
+	auto free_list = ::std::make_unique<index_queue>(io_buffer_count);
+	for (::uint32_t i = 0; i != io_buffer_count; ++i)
+		free_list->push(i);
+	// Big pools end up on transparent huge pages, so that there are fewer pages to pin
+	io_buffer_memory = ::jpl::huge_page_allocator<char>{}.allocate(::size_t(io_buffer_count) * io_buffer_bytes);
+	free_io_buffers = ::std::move(free_list);
+}
+
+void release_io_buffers() noexcept {
+	if (!io_buffer_count)
+		return;
+	::jpl::huge_page_allocator<char>{}.deallocate(io_buffer_memory, ::size_t(io_buffer_count) * io_buffer_bytes);
+	free_io_buffers.reset();
+	io_buffer_count = 0;
+}
+
+// Failing is fine, read_fixed then does plain reads
+void register_io_buffers() noexcept {
+	if (!io_buffer_count)
+		return;
+	::iovec iovecs[UIO_MAXIOV];
+	for (::uint32_t i = 0; i != io_buffer_count; ++i)
+		iovecs[i] = { io_buffer_memory + ::size_t(i) * io_buffer_bytes, io_buffer_bytes };
+	io_buffers_registered = ::syscall(SYS_io_uring_register, fd, IORING_REGISTER_BUFFERS, iovecs, io_buffer_count) == 0;
+}
+
+void alloc_io_files(::uint32_t n_files) {
+	::rlimit limit;
+	if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < n_files)
+		n_files = ::uint32_t(limit.rlim_cur);
+	io_file_count = n_files;
+	io_files_registered = false;
+	if (!io_file_count)
+		return;
+	free_io_files = ::std::make_unique<index_queue>(io_file_count);
+	for (::uint32_t i = 0; i != io_file_count; ++i)
+		free_io_files->push(i);
+}
+
+// An empty table, which read_file fills as it goes. Failing is fine, read_file then uses file descriptors.
+void register_io_files() noexcept {
+	if (!io_file_count)
+		return;
+	::std::unique_ptr<int[]> fds{ new (::std::nothrow) int[io_file_count] };
+	if (!fds)
+		return;
+	::std::fill_n(fds.get(), io_file_count, -1);
+	io_files_registered = ::syscall(SYS_io_uring_register, fd, IORING_REGISTER_FILES, fds.get(), io_file_count) == 0;
+}
+
+void init_io(const conf& config) {
 	const char* err;
 	::io_uring_params params{};
 	unsigned* sq_array; // This needs to be forward declared for gotos to work
 
+	alloc_io_buffers(config.io_buffers, config.io_buffer_size);
+	alloc_io_files(config.io_files);
+
 	fd = ::syscall(SYS_io_uring_setup, 512, &params);
 	if (fd < 0) {
 		err = "io_uring_setup failed";
@@ -155,6 +745,9 @@ void init_io() {
 	cq_mask = *reinterpret_cast<unsigned*>(static_cast<char*>(uring_ptr) + params.cq_off.ring_mask);
 	
 	sq_entries = params.sq_entries;
+	// 0x7ffff000 is MAX_RW_COUNT, the most the kernel reads or writes at once
+	io_chunk_size = ::std::clamp<::uint32_t>(config.io_chunk_size, 4096, 0x7ffff000) & ~::uint32_t(4095);
+	io_chunks_in_flight = ::std::clamp<::uint32_t>(config.io_chunks_in_flight, 1, sq_entries / 2);
 
 	sq_array = reinterpret_cast<unsigned*>(static_cast<char*>(uring_ptr) + params.sq_off.array);
 	for (unsigned i = 0; i != params.sq_entries; ++i)
@@ -172,24 +765,30 @@ void init_io() {
 	}
 	cqes = reinterpret_cast<::io_uring_cqe*>(static_cast<char*>(uring_ptr) + params.cq_off.cqes);
 
-	timeout_sqe = io_uring_sqe{
+	timeout_sqe = make_sqe({
 		.opcode = IORING_OP_TIMEOUT,
 		.fd = fd,
 		.off = 1, // Number of events to wait for!
 		.addr = reinterpret_cast<::uint64_t>(&timeout_ts),
 		.len = 1,
-	};
+	});
+	register_io_buffers();
+	register_io_files();
 	return;
 
 	err3: ::munmap(uring_ptr, uring_size);
 	err2: ::close(fd);
-	err1: throw ::std::runtime_error{ err };
+	err1: release_io_buffers();
+	free_io_files.reset();
+	throw ::std::runtime_error{ err };
 }
 
 void free_io() {
 	::munmap(sqes     , sqes_size);
 	::munmap(uring_ptr, uring_size);
 	::close(fd);
+	release_io_buffers();
+	free_io_files.reset();
 }
 
 void add_timeout_event(clock::duration timeout) {
@@ -199,8 +798,13 @@ void add_timeout_event(clock::duration timeout) {
 		sq_head_local = *sq_head;
 		if ((sq_tail_local - sq_head_local) >= (sq_entries)) [[unlikely]] {
 			request_t request = turn_request;
-			if (request.active)
+			// The waiter whose turn was taken last time hasn't moved on yet. It may be asleep on a timer, and only this
+			// thread processes those.
+			if (request.active) {
+				process_timed();
+				::std::this_thread::yield();
 				continue;
+			}
 			turn = sq_head_local + sq_entries - 1;
 			turn_request = request_t{ turn, true };
 			success = true;
@@ -215,6 +819,10 @@ void add_timeout_event(clock::duration timeout) {
 	sqe_sync[idx] = turn + 1;
 }
 
+bool io_pending() noexcept {
+	return pending_io || (sq_tail_local != *sq_tail);
+}
+
 void process_io(clock::duration timeout) {
 	clock::time_point now = clock::now();
 	clock::time_point deadline = now + timeout;
@@ -253,9 +861,11 @@ void process_io(clock::duration timeout) {
 			::io_uring_cqe& cqe = cqes[idx];
 
 			if (cqe.user_data) {
-				::std::coroutine_handle<> handle;
-				::memcpy(&handle, &cqe.user_data, 8);
-				enqueue(handle);
+				detail::io_request* request = reinterpret_cast<detail::io_request*>(cqe.user_data);
+				request->result = cqe.res;
+				detail::io_request* first = request->first ? request->first : request;
+				if (--first->pending == 0)
+					enqueue(first->handle);
 				detail::pending_tasks--;
 			} else {
 				if (cqe.res == -ETIME)
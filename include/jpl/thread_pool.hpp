@@ -3,6 +3,7 @@
 
 #include <jpl/vector.hpp>
 #include <jpl/bits/thread_pool/task.hpp>
+#include <jpl/bits/thread_pool/timer_wheel.hpp>
 
 #if __has_include(<coroutine>)
 #include <coroutine>
@@ -13,37 +14,196 @@ namespace std { using namespace experimental; }
 #error "requires C++20 coroutines"
 #endif
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+#include <jpl/bits/allocator.hpp>
+#include <jpl/bits/thread_pool/lazy.hpp>
+#include <jpl/bits/thread_pool/when_all.hpp>
+
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+
+#ifdef JPL_TP_QUEUE_STATS
+#include <jpl/concurrent_queue.hpp>
+#endif
 
 namespace jpl::tp {
 
 using clock = ::std::chrono::steady_clock;
 
+// Workers prefer higher priority lanes, but lower lanes are guaranteed a minimum share of picks (see conf::min_share)
+enum class priority : ::uint8_t { high, normal, low };
+inline constexpr ::size_t n_priorities{ 3 };
+
+// How workers are pinned to CPUs. With pinning, NUMA topology is read from sysfs, and every node gets its own queues,
+// allocated in the node's memory.
+enum class affinity : ::uint8_t {
+	none,    // Threads float freely, and all nodes share the same queues
+	compact, // Fill up the first node's CPUs before moving on to the next one
+	scatter, // Round robin over nodes, so that every node gets an even share of the workers
+	list,    // Worker i is pinned to conf::cpus[i], wrapping around if there are more workers than CPUs
+};
+
+// Idle threads spin for a while before parking, so that a task arriving right after doesn't pay for a futex wake.
+// Spinning keeps the core busy though, so lower max_spin (or turn it off with 0) when power matters more than latency.
+struct idle_conf {
+	clock::duration max_spin{ ::std::chrono::microseconds{ 50 } };
+	::uint32_t n_yields = 2; // std::this_thread::yield() calls between spinning and parking
+	bool adaptive = true;    // Adjust the spin budget to the observed gaps between tasks, with max_spin as the limit
+};
+
+struct conf {
+	::size_t n_threads = 0; // 0 = std::thread::hardware_concurrency()
+	// While a lane has work, at least every nth pick of each worker goes to it. 0 = no guarantee.
+	// The high lane is always picked first, so its value is ignored.
+	::uint32_t min_share[n_priorities] = { 0, 8, 32 };
+	affinity pinning = affinity::none;
+	::std::span<const ::uint32_t> cpus{}; // For affinity::list. Only read during init().
+	idle_conf idle{};
+	// Buffers for read_fixed, registered with io_uring so that the kernel doesn't have to pin and unpin their pages
+	// on every read. Registered memory is locked, and counts against RLIMIT_MEMLOCK. If registering fails, read_fixed
+	// still works, with plain reads into the same buffers. At most 1024 buffers.
+	::uint32_t io_buffers = 32;
+	::uint32_t io_buffer_size = 64 * 1024;
+	// Slots in the ring's file table, which read_file opens files into as direct descriptors, so that they don't
+	// take up file descriptors. This many files can be open at once, and further read_files wait for a slot.
+	// Capped to RLIMIT_NOFILE, since the kernel won't register more. If registering fails, read_file uses normal
+	// file descriptors.
+	::uint32_t io_files = 4096;
+	// Files bigger than io_chunk_size are read in chunks of that size, with up to io_chunks_in_flight of them
+	// submitted at once, so that the device can work on several. The size is rounded down to a multiple of 4096, and
+	// capped to the most a single read can return. The depth is capped to half the SQ.
+	::uint32_t io_chunk_size = 1024 * 1024;
+	::uint32_t io_chunks_in_flight = 8;
+};
+
 struct handle { ~handle(); };
 [[nodiscard]] handle init(::size_t n_threads = 0);
+[[nodiscard]] handle init(const conf& config);
 void join() noexcept;
+// Number of tasks that didn't fit in the shared ring buffers, and are waiting in the unbounded overflow lists
+::uint64_t overflow_depth() noexcept;
+
+// Time tasks have spent queued in a lane's shared queue before a worker picked them up.
+// Tasks that a worker enqueues and runs itself through its local deque aren't counted.
+struct latency_stats {
+	::uint64_t n_tasks;
+	clock::duration total;
+	clock::duration max;
 
+	clock::duration mean() const noexcept {
+		return n_tasks ? total / clock::rep(n_tasks) : clock::duration{};
+	}
+};
+latency_stats queue_latency(priority p) noexcept;
+
+// How idle workers and timer threads found their next task: while spinning, after yielding, or after parking
+struct idle_stats {
+	::uint64_t spin_hits;
+	::uint64_t yield_hits;
+	::uint64_t parks;
+};
+idle_stats idle_counters() noexcept;
+
+#ifdef JPL_TP_QUEUE_STATS
+// Statistics of a lane's shared ring buffers, added up over every node, with max_size being the largest of them.
+// Only with JPL_TP_QUEUE_STATS, since collecting them makes every push a bit slower.
+::jpl::queue_stats lane_queue_stats(priority p) noexcept;
+// Same for the queue of expired timers that the timer threads run
+::jpl::queue_stats timer_queue_stats() noexcept;
+#endif
+
+// Number of worker threads
+::size_t n_threads() noexcept;
+// Index of the calling worker in [0, n_threads()), or n_threads() for any thread outside the pool.
+// Meant for per-worker accumulators: allocate n_threads() + 1 of them, and keep in mind that the last one is shared
+// by every thread outside the pool.
+::size_t thread_index() noexcept;
+
+// Number of nodes with their own queues. Always 1 without pinning.
+::size_t n_nodes() noexcept;
+// Node of the calling worker, or for other threads, of the CPU they're currently running on
+::size_t current_node() noexcept;
+// Queues the task on a specific node, so that workers on that node pick it up first.
+// Workers on other nodes still take it when they run out of work.
+inline void enqueue_on(::size_t node, priority p, task&& t) noexcept;
+inline void enqueue_on(::size_t node, task&& t) noexcept;
+
+inline void enqueue(priority p, task&& t) noexcept;
 inline void enqueue(task&& t) noexcept;
-inline void enqueue(auto&& func, auto&& ... args) noexcept {
+inline void enqueue(priority p, auto&& func, auto&& ... args) noexcept {
 	if constexpr (sizeof...(args) > 0) {
-		enqueue(task{
+		enqueue(p, task{
 			[func = static_cast<decltype(func)&&>(func), ...args = static_cast<decltype(args)&&>(args)]() mutable {
 				static_cast<decltype(func)&&>(func)(static_cast<decltype(args)&&>(args)...);
 			}
 		});
 	} else {
-		enqueue(task{ static_cast<decltype(func)&&>(func) });
+		enqueue(p, task{ static_cast<decltype(func)&&>(func) });
+	}
+}
+inline void enqueue(auto&& func, auto&& ... args) noexcept
+	requires(!::std::is_same_v<::std::remove_cvref_t<decltype(func)>, priority>)
+{
+	enqueue(priority::normal, static_cast<decltype(func)&&>(func), static_cast<decltype(args)&&>(args)...);
+}
+
+// Runs the coroutine on the thread pool, without anyone waiting for it. The frame is freed when it finishes.
+// An exception escaping it calls std::terminate, since there's nobody to hand it to.
+inline void spawn(lazy<void>&& l) noexcept {
+	enqueue(detail::run_detached(static_cast<lazy<void>&&>(l)).handle);
+}
+inline void spawn(priority p, lazy<void>&& l) noexcept {
+	enqueue(p, detail::run_detached(static_cast<lazy<void>&&>(l)).handle);
+}
+
+// Handle to a task scheduled with enqueue_at/enqueue_after. Dropping the handle doesn't cancel the task.
+class timer {
+	detail::timer_node* node;
+
+	public:
+	timer() noexcept : node{ nullptr } {}
+	explicit timer(detail::timer_node* node) noexcept : node{ node } {}
+	timer(timer&& other) noexcept : node{ other.node } {
+		other.node = nullptr;
+	}
+	timer& operator=(timer&& other) noexcept {
+		detail::timer_node* temp = node;
+		node = other.node;
+		other.node = temp;
+		return *this;
 	}
+	~timer() noexcept {
+		if (node) node->release();
+	}
+
+	timer(const timer&) = delete;
+	timer& operator=(const timer&) = delete;
+
+	// Returns true if the task was cancelled before it was queued for running. O(1).
+	bool cancel() noexcept;
+};
+
+timer enqueue_at(clock::time_point when, task&& t);
+inline timer enqueue_after(clock::duration duration, task&& t) {
+	return enqueue_at(clock::now() + duration, static_cast<task&&>(t));
 }
 
 struct try_yield {
 	const bool resumed;
-	try_yield() noexcept;
+	const priority lane;
+	try_yield(priority lane = priority::normal) noexcept;
 	bool await_ready() const noexcept { return !resumed; }
 	void await_suspend(::std::coroutine_handle<> handle) noexcept;
 	bool await_resume() const noexcept { return resumed; }
 };
 
 struct yield {
+	priority lane = priority::normal;
 	static constexpr bool await_ready() noexcept { return false; }
 	void await_suspend(::std::coroutine_handle<> handle) noexcept;
 	static constexpr void await_resume() noexcept {}
@@ -51,6 +211,7 @@ struct yield {
 
 struct sleep_for {
 	clock::duration duration;
+	detail::timer_node node{};
 	static constexpr bool await_ready() noexcept { return false; }
 	void await_suspend(::std::coroutine_handle<> handle) noexcept;
 	static constexpr void await_resume() noexcept {}
@@ -58,27 +219,149 @@ struct sleep_for {
 
 struct sleep_until {
 	clock::time_point ts;
+	detail::timer_node node{};
 	bool await_ready() const noexcept { return clock::now() > ts; }
 	void await_suspend(::std::coroutine_handle<> handle) noexcept;
 	static constexpr void await_resume() noexcept {}
 };
 
-struct read_file_awaiter {
+namespace detail {
+// An SQE's user_data points to one of these. When its CQE arrives, the result is stored in it, and once every SQE of
+// its chain has completed, the coroutine of the chain's first request is resumed on the thread pool.
+struct io_request {
+	::std::coroutine_handle<> handle;
+	::int32_t result;
+	::uint32_t pending{ 1 };      // CQEs the chain is still waiting for. Only used in the first request.
+	io_request* first{ nullptr }; // nullptr in the first request itself
+};
+} // namespace detail
+
+// Reads a whole file without any blocking syscalls on the worker: OPENAT and STATX go to io_uring as one linked
+// chain, and READ and CLOSE as another, once the size is known. Files bigger than conf::io_chunk_size are read in
+// chunks instead, several at a time, and closed after. Short reads are resubmitted for the rest, and the vector ends
+// where the file did, if it shrank in the meantime. file_path has to stay valid until it's done.
+// Throws std::system_error if opening, statx or reading fails.
+lazy<::jpl::vector<char>> read_file(const char* file_path);
+
+// One of the buffers of conf::io_buffers, leased by read_fixed, holding the bytes it read. Gives the buffer back to
+// the pool when destroyed.
+class io_buffer {
+	::uint32_t index;
+	::std::span<char> bytes;
+
+	io_buffer(::uint32_t index, ::std::span<char> bytes) noexcept : index{ index }, bytes{ bytes } {}
+	friend lazy<io_buffer> read_fixed(int fd, ::uint64_t offset, ::uint32_t length);
+
+	public:
+	io_buffer() noexcept : index{ UINT32_MAX } {}
+	io_buffer(io_buffer&& other) noexcept : index{ other.index }, bytes{ other.bytes } {
+		other.index = UINT32_MAX;
+	}
+	io_buffer& operator=(io_buffer&& other) noexcept {
+		::std::swap(index, other.index);
+		::std::swap(bytes, other.bytes);
+		return *this;
+	}
+	~io_buffer();
+
+	[[nodiscard]] char* data() const noexcept { return bytes.data(); }
+	[[nodiscard]] ::size_t size() const noexcept { return bytes.size(); }
+	[[nodiscard]] ::std::span<char> span() const noexcept { return bytes; }
+};
+
+// Reads up to length bytes from fd at offset with IORING_OP_READ_FIXED, into a leased io_buffer. length is capped to
+// conf::io_buffer_size. If every buffer is leased, waits for one to come back, without blocking the worker.
+// Throws std::system_error if the read fails, and std::logic_error if the pool has no buffers.
+lazy<io_buffer> read_fixed(int fd, ::uint64_t offset, ::uint32_t length);
+
+// Reads from fd at offset straight into buffer, which can be any memory the caller has, like part of a vector or of an
+// mmap'ed arena. Nothing is allocated, since the awaiter lives in the awaiting coroutine's frame. Gives the number of
+// bytes read, which like with pread(2) is less than buffer.size() only at the end of the file, or when it's more than
+// the 0x7ffff000 bytes the kernel reads at once. For whole files, read_file splits and resubmits as needed.
+// Throws std::system_error if the read fails.
+struct read_at {
 	int fd;
-	::jpl::vector<char> buffer;
-	read_file_awaiter(int fd);
-	bool await_ready() noexcept { return fd < 0; }
+	::uint64_t offset;
+	::std::span<::std::byte> buffer;
+	detail::io_request request{};
+	static constexpr bool await_ready() noexcept { return false; }
 	void await_suspend(::std::coroutine_handle<> handle);
-	::jpl::vector<char>&& await_resume() noexcept {
-		return static_cast<::jpl::vector<char>&&>(buffer);
-	}
+	::size_t await_resume() const;
 };
-read_file_awaiter read_file(const char* file_path);
+
+#ifdef __linux__
+// Like read_at, but fills buffers one after another with a single IORING_OP_READV, like preadv(2). The iovecs, at most
+// IOV_MAX of them, have to stay valid until it's done.
+struct readv_at {
+	int fd;
+	::uint64_t offset;
+	::std::span<const ::iovec> buffers;
+	detail::io_request request{};
+	static constexpr bool await_ready() noexcept { return false; }
+	void await_suspend(::std::coroutine_handle<> handle);
+	::size_t await_resume() const;
+};
+#endif
+
+// How a write is made durable once it's done
+enum class io_sync : ::uint8_t {
+	none,
+	data, // Like fdatasync: the data, and the metadata needed to read it back
+	all,  // Like fsync
+};
+
+// O_DIRECT needs the memory, size and file offset of a transfer aligned to the device's logical block size. This is
+// what write_file checks against, since every device accepts it.
+inline constexpr ::size_t direct_io_alignment{ 4096 };
+
+// Page aligned, so it can be written with O_DIRECT, as long as its size is a multiple of direct_io_alignment
+template<class T = ::std::byte>
+using direct_io_vector = ::jpl::vector<T, 0, ::jpl::huge_page_allocator<T>>;
+
+struct write_options {
+	io_sync sync = io_sync::none;
+	bool append = false;    // Add to the end of the file, instead of replacing what's in it
+	bool direct = false;    // O_DIRECT, bypassing the page cache. The data has to be aligned to direct_io_alignment.
+	::uint32_t mode = 0644; // Of a newly created file, before the umask
+};
+
+// Writes data to file_path, creating the file if needed, without any blocking syscalls on the worker. With the file
+// table (conf::io_files) and data within conf::io_chunk_size, OPENAT, WRITE, the sync and CLOSE go to io_uring as a
+// single linked chain. Otherwise the file is opened first, and the data is written in chunks, several at a time, like
+// read_file reads. Short writes are resubmitted for the rest, and the sync only starts once all of the data is written.
+// file_path and data have to stay valid until it's done.
+// Throws std::system_error if opening, writing, syncing or closing fails, and std::invalid_argument if direct data
+// isn't aligned.
+lazy<void> write_file(const char* file_path, ::std::span<const ::std::byte> data, write_options options = {});
+
+// Writes all of data to fd at offset, in chunks if it's bigger than conf::io_chunk_size, and resubmits short writes.
+// A sync is linked to the write, so it only starts once the data is written. If fd was opened with O_DIRECT, data and
+// offset have to be aligned. Throws std::system_error if writing or syncing fails.
+lazy<void> write_at(int fd, ::uint64_t offset, ::std::span<const ::std::byte> data, io_sync sync = io_sync::none);
+
+// Like write_at, but at fd's file position, which moves past the data. If fd was opened with O_APPEND, that's the end
+// of the file, even with other processes appending to it. Chunks are linked, so that they land in order, but another
+// writer's data can still end up between two of them.
+lazy<void> append(int fd, ::std::span<const ::std::byte> data, io_sync sync = io_sync::none);
 
 void process_timed();
 
+namespace detail {
+// Runs one queued task on the calling thread, if there is one
+bool try_run_task();
+// Whether a task that's working through a range should split off part of it: on a worker, when its local deque is
+// empty (so any earlier split has been stolen), elsewhere when some worker is idle
+bool should_split() noexcept;
+// Processes IO completions and timers, waiting for up to max_wait for something to happen, or for wake_word to change
+// from expected. Returns false if another thread is already processing them.
+bool try_process_events(clock::duration max_wait, ::std::atomic<::uint32_t>* wake_word = nullptr, ::uint32_t expected = 0);
+} // namespace detail
+
 } // namespace jpl::tp
 
+#include <jpl/bits/thread_pool/task_group.hpp>
+#include <jpl/bits/thread_pool/parallel.hpp>
+
 #ifdef JPL_HEADER_ONLY
 #ifndef JPL_THREAD_POOL_IMPL
 #define JPL_THREAD_POOL_IMPL
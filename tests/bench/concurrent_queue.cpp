@@ -0,0 +1,102 @@
+// Compares jpl::concurrent_queue's push_bulk / pop_bulk against looping over push / pop, with producers that
+// generate items in batches.
+// Usage: concurrent_queue [n_producers] [n_consumers]
+
+#include <jpl/concurrent_queue.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+using clock_type = ::std::chrono::steady_clock;
+using queue_type = ::jpl::concurrent_queue<::uint64_t, 4096, false>;
+
+constexpr ::uint64_t n_items{ 1u << 23 };
+
+// Consumers are given a fixed share of the items, so that they know when to stop
+void consume(queue_type& queue, ::uint64_t n, ::uint32_t batch, bool bulk, ::uint64_t& checksum) {
+	::uint64_t sum = 0;
+	::std::unique_ptr<::uint64_t[]> out{ new ::uint64_t[batch] };
+	while (n) {
+		if (bulk) {
+			const ::uint32_t want = n < batch ? ::uint32_t(n) : batch;
+			::uint32_t got = queue.pop_bulk(out.get(), want);
+			// Nothing ready, so block on a single element instead of spinning
+			if (got == 0) {
+				out[0] = queue.pop();
+				got = 1;
+			}
+			for (::uint32_t i = 0; i != got; ++i)
+				sum += out[i];
+			n -= got;
+		} else {
+			sum += queue.pop();
+			--n;
+		}
+	}
+	checksum = sum;
+}
+
+void produce(queue_type& queue, ::uint64_t n, ::uint32_t batch, bool bulk) {
+	::std::unique_ptr<::uint64_t[]> items{ new ::uint64_t[batch] };
+	for (::uint64_t produced = 0; produced != n; ) {
+		const ::uint32_t count = (n - produced) < batch ? ::uint32_t(n - produced) : batch;
+		for (::uint32_t i = 0; i != count; ++i)
+			items[i] = produced + i;
+		if (bulk) {
+			queue.push_bulk(items.get(), items.get() + count);
+		} else {
+			for (::uint32_t i = 0; i != count; ++i)
+				queue.push(items[i]);
+		}
+		produced += count;
+	}
+}
+
+void bench(::uint32_t n_producers, ::uint32_t n_consumers, ::uint32_t batch, bool bulk) {
+	auto queue = ::std::make_unique<queue_type>();
+	::std::vector<::uint64_t> checksums(n_consumers);
+	::std::vector<::std::thread> threads;
+
+	const auto start = clock_type::now();
+	for (::uint32_t i = 0; i != n_consumers; ++i) {
+		const ::uint64_t share = n_items / n_consumers + (i < n_items % n_consumers);
+		threads.emplace_back([&, i, share] { consume(*queue, share, batch, bulk, checksums[i]); });
+	}
+	for (::uint32_t i = 0; i != n_producers; ++i) {
+		const ::uint64_t share = n_items / n_producers + (i < n_items % n_producers);
+		threads.emplace_back([&, share] { produce(*queue, share, batch, bulk); });
+	}
+	for (auto& t : threads)
+		t.join();
+	const ::std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+	::uint64_t expected = 0, actual = 0;
+	for (::uint32_t i = 0; i != n_producers; ++i) {
+		const ::uint64_t share = n_items / n_producers + (i < n_items % n_producers);
+		expected += share * (share - 1) / 2;
+	}
+	for (::uint64_t sum : checksums)
+		actual += sum;
+	if (actual != expected)
+		::fmt::print("checksum mismatch: {} != {}\n", actual, expected);
+
+	::fmt::print("{}P/{}C batch {:4} {:6} | {:8.3f} ms | {:7.2f} M items/s\n",
+		n_producers, n_consumers, batch, bulk ? "bulk" : "single",
+		elapsed.count() * 1e3, n_items / elapsed.count() * 1e-6);
+}
+
+int main(int argc, char** argv) {
+	const ::uint32_t n_producers = argc > 1 ? ::uint32_t(::strtoul(argv[1], nullptr, 10)) : 2;
+	const ::uint32_t n_consumers = argc > 2 ? ::uint32_t(::strtoul(argv[2], nullptr, 10)) : 2;
+
+	for (::uint32_t batch : { 1u, 16u, 256u, 1024u }) {
+		bench(n_producers, n_consumers, batch, false);
+		bench(n_producers, n_consumers, batch, true);
+	}
+}
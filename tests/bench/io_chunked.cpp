@@ -0,0 +1,68 @@
+// Reads one big file with tp::read_file, split into chunks with a given number of them in flight. Run it with
+// increasing depths to see how far throughput scales with queue depth. The file is written first, so on tmpfs or a
+// warm page cache this measures the copy out of the cache. For the device, drop the caches before reading, or point it
+// at a file bigger than memory.
+// Usage: io_chunked [chunks_in_flight] [directory] [file_size_in_MiB] [chunk_size_in_KiB]
+
+#define JPL_HEADER_ONLY
+#include <jpl/thread_pool.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace tp = ::jpl::tp;
+
+constexpr ::uint32_t n_rounds{ 4 };
+
+::uint64_t bytes_read;
+
+tp::lazy<void> read_whole(const char* path) {
+	::jpl::vector<char> data = co_await tp::read_file(path);
+	bytes_read += data.size();
+}
+
+int main(int argc, char** argv) {
+	const ::uint32_t depth = argc > 1 ? ::uint32_t(::strtoul(argv[1], nullptr, 10)) : 8;
+	const char* dir = argc > 2 ? argv[2] : "/tmp";
+	const ::uint64_t file_size = (argc > 3 ? ::strtoull(argv[3], nullptr, 10) : 256) << 20;
+	const ::uint32_t chunk_size = (argc > 4 ? ::uint32_t(::strtoul(argv[4], nullptr, 10)) : 1024) << 10;
+
+	const ::std::string path = ::fmt::format("{}/jpl_io_chunked_{}", dir, ::getpid());
+	{
+		::FILE* file = ::fopen(path.c_str(), "wb");
+		if (!file)
+			return 1;
+		const ::std::string block(1 << 20, 'x');
+		for (::uint64_t written = 0; written < file_size; written += block.size())
+			::fwrite(block.data(), 1, ::std::min<::uint64_t>(block.size(), file_size - written), file);
+		::fclose(file);
+	}
+
+	{
+		tp::conf config;
+		config.io_chunk_size = chunk_size;
+		config.io_chunks_in_flight = depth;
+		auto handle = tp::init(config);
+
+		const auto start = tp::clock::now();
+		for (::uint32_t round = 0; round != n_rounds; ++round) {
+			tp::spawn(read_whole(path.c_str()));
+			tp::join();
+		}
+		const ::std::chrono::duration<double> elapsed = tp::clock::now() - start;
+		if (bytes_read != n_rounds * file_size)
+			::fmt::print("read {} bytes instead of {}\n", bytes_read, n_rounds * file_size);
+		::fmt::print("{:2} in flight | {:8.3f} ms | {:7.1f} MB/s\n",
+			depth, elapsed.count() * 1e3, bytes_read / elapsed.count() * 1e-6);
+	}
+
+	::unlink(path.c_str());
+}
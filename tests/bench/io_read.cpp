@@ -0,0 +1,93 @@
+// Small file reads through io_uring: tp::read_file, which opens, sizes, reads and closes the file with linked SQEs and
+// reads into a newly allocated vector, against tp::read_fixed, which reads into a leased buffer that's registered with
+// the ring, with IORING_OP_READ_FIXED, from a file opened with a blocking ::open on the worker.
+// The files are written to a temporary directory first, so they're in the page cache, and the kernel's per-read
+// work (pinning the pages of the buffer, for plain reads) is a bigger share of the time.
+// Usage: io_read [n_threads] [file_size]
+
+#define JPL_HEADER_ONLY
+#include <jpl/thread_pool.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace tp = ::jpl::tp;
+
+constexpr ::uint32_t n_files{ 512 };
+constexpr ::uint32_t n_rounds{ 20 };
+
+::std::atomic<::uint64_t> bytes_read;
+
+tp::lazy<void> read_plain(const char* path) {
+	::jpl::vector<char> data = co_await tp::read_file(path);
+	bytes_read += data.size();
+}
+
+tp::lazy<void> read_fixed(const char* path, ::uint32_t file_size) {
+	const int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		co_return;
+	tp::io_buffer buffer = co_await tp::read_fixed(fd, 0, file_size);
+	::close(fd);
+	bytes_read += buffer.size();
+}
+
+template<class F>
+void bench(const char* name, const ::std::vector<::std::string>& paths, ::uint32_t file_size, F&& read) {
+	bytes_read = 0;
+	const auto start = tp::clock::now();
+	for (::uint32_t round = 0; round != n_rounds; ++round) {
+		for (const ::std::string& path : paths)
+			tp::spawn(read(path.c_str()));
+		tp::join();
+	}
+	const ::std::chrono::duration<double> elapsed = tp::clock::now() - start;
+	const ::uint64_t n_reads = ::uint64_t(n_files) * n_rounds;
+	if (bytes_read != n_reads * file_size)
+		::fmt::print("read {} bytes instead of {}\n", bytes_read.load(), n_reads * file_size);
+	::fmt::print("{:<10} | {:8.3f} ms | {:8.1f} k files/s | {:7.1f} MB/s\n",
+		name, elapsed.count() * 1e3, n_reads / elapsed.count() * 1e-3, bytes_read / elapsed.count() * 1e-6);
+}
+
+int main(int argc, char** argv) {
+	const ::size_t n_threads = argc > 1 ? ::strtoul(argv[1], nullptr, 10) : 0;
+	const ::uint32_t file_size = argc > 2 ? ::uint32_t(::strtoul(argv[2], nullptr, 10)) : 4096;
+
+	char dir[] = "/tmp/jpl_io_read_XXXXXX";
+	if (!::mkdtemp(dir))
+		return 1;
+	::std::vector<::std::string> paths;
+	const ::std::string contents(file_size, 'x');
+	for (::uint32_t i = 0; i != n_files; ++i) {
+		paths.push_back(::fmt::format("{}/{}", dir, i));
+		::FILE* file = ::fopen(paths.back().c_str(), "wb");
+		::fwrite(contents.data(), 1, contents.size(), file);
+		::fclose(file);
+	}
+
+	{
+		tp::conf config;
+		config.n_threads = n_threads;
+		// A buffer per file, so that read_fixed never waits for one. Workers' submissions only reach the kernel when
+		// the thread processing IO gets around to it, so reads trickling in as buffers come back would measure that.
+		config.io_buffers = n_files;
+		config.io_buffer_size = file_size;
+		auto handle = tp::init(config);
+		bench("read_file",  paths, file_size, [](const char* path) { return read_plain(path); });
+		bench("read_fixed", paths, file_size, [&](const char* path) { return read_fixed(path, file_size); });
+	}
+
+	for (const ::std::string& path : paths)
+		::unlink(path.c_str());
+	::rmdir(dir);
+}
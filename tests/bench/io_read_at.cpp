@@ -0,0 +1,128 @@
+// Small reads at random offsets of one file, like looking things up in an index: tp::read_at into a buffer in the
+// coroutine's frame, tp::read_fixed into a leased registered buffer, and a blocking ::pread on the worker. Besides
+// the rate, it counts heap allocations per read, by replacing operator new.
+// The file is in the page cache, where pread takes a microsecond, so the io_uring reads mostly measure how long a
+// submission waits for the thread processing IO. Each task only has one read in flight, so more tasks hide more of it.
+// Usage: io_read_at [directory] [read_size] [n_concurrent]
+
+#define JPL_HEADER_ONLY
+#include <jpl/thread_pool.hpp>
+#include <jpl/random.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace tp = ::jpl::tp;
+
+::std::atomic<::uint64_t> n_allocations;
+
+void* operator new(::size_t size) {
+	n_allocations.fetch_add(1, ::std::memory_order::relaxed);
+	if (void* ptr = ::malloc(size ? size : 1))
+		return ptr;
+	throw ::std::bad_alloc{};
+}
+void operator delete(void* ptr) noexcept { ::free(ptr); }
+void operator delete(void* ptr, ::size_t) noexcept { ::free(ptr); }
+
+constexpr ::uint64_t file_size{ 64u << 20 };
+constexpr ::uint32_t reads_per_task{ 256 };
+constexpr ::uint32_t max_read_size{ 64 * 1024 };
+
+::std::atomic<::uint64_t> checksum;
+
+::uint64_t random_offset(::jpl::pcg32& rng, ::uint32_t read_size) {
+	return ((::uint64_t(rng()) << 32 | rng()) % (file_size - read_size)) & ~::uint64_t(511);
+}
+
+tp::lazy<void> with_read_at(int fd, ::uint32_t read_size, ::uint32_t seed) {
+	::jpl::pcg32 rng{ seed };
+	::std::byte buffer[max_read_size];
+	::uint64_t sum = 0;
+	for (::uint32_t i = 0; i != reads_per_task; ++i) {
+		const ::size_t n = co_await tp::read_at(fd, random_offset(rng, read_size), ::std::span{ buffer, read_size });
+		sum += ::uint64_t(buffer[n - 1]);
+	}
+	checksum += sum;
+}
+
+tp::lazy<void> with_read_fixed(int fd, ::uint32_t read_size, ::uint32_t seed) {
+	::jpl::pcg32 rng{ seed };
+	::uint64_t sum = 0;
+	for (::uint32_t i = 0; i != reads_per_task; ++i) {
+		tp::io_buffer buffer = co_await tp::read_fixed(fd, random_offset(rng, read_size), read_size);
+		sum += ::uint64_t(::uint8_t(buffer.data()[buffer.size() - 1]));
+	}
+	checksum += sum;
+}
+
+tp::lazy<void> with_pread(int fd, ::uint32_t read_size, ::uint32_t seed) {
+	::jpl::pcg32 rng{ seed };
+	::std::byte buffer[max_read_size];
+	::uint64_t sum = 0;
+	for (::uint32_t i = 0; i != reads_per_task; ++i) {
+		const ::ssize_t n = ::pread(fd, buffer, read_size, ::off_t(random_offset(rng, read_size)));
+		sum += ::uint64_t(buffer[n - 1]);
+	}
+	checksum += sum;
+	co_return;
+}
+
+template<class F>
+void bench(const char* name, ::uint32_t n_tasks, F&& task) {
+	checksum = 0;
+	const ::uint64_t allocations_before = n_allocations.load();
+	const auto start = tp::clock::now();
+	for (::uint32_t i = 0; i != n_tasks; ++i)
+		tp::spawn(task(i + 1));
+	tp::join();
+	const ::std::chrono::duration<double> elapsed = tp::clock::now() - start;
+	const ::uint64_t n_reads = ::uint64_t(n_tasks) * reads_per_task;
+	::fmt::print("{:<10} | {:8.3f} ms | {:7.1f} k reads/s | {:6.3f} allocations/read | checksum {}\n",
+		name, elapsed.count() * 1e3, n_reads / elapsed.count() * 1e-3,
+		double(n_allocations.load() - allocations_before) / n_reads, checksum.load());
+}
+
+int main(int argc, char** argv) {
+	const char* dir = argc > 1 ? argv[1] : "/tmp";
+	::uint32_t read_size = argc > 2 ? ::uint32_t(::strtoul(argv[2], nullptr, 10)) : 4096;
+	read_size = read_size < 1 ? 1 : read_size > max_read_size ? max_read_size : read_size;
+	const ::uint32_t n_tasks = argc > 3 ? ::uint32_t(::strtoul(argv[3], nullptr, 10)) : 256;
+
+	const ::std::string path = ::fmt::format("{}/jpl_io_read_at_{}", dir, ::getpid());
+	{
+		::FILE* file = ::fopen(path.c_str(), "wb");
+		if (!file)
+			return 1;
+		::jpl::pcg32 rng{ 7 };
+		for (::uint64_t i = 0; i != file_size / 4; ++i) {
+			const ::uint32_t word = rng();
+			::fwrite(&word, 4, 1, file);
+		}
+		::fclose(file);
+	}
+	const int fd = ::open(path.c_str(), O_RDONLY);
+
+	{
+		tp::conf config;
+		config.io_buffers = n_tasks;
+		config.io_buffer_size = read_size;
+		auto handle = tp::init(config);
+		bench("read_at", n_tasks, [&](::uint32_t seed) { return with_read_at(fd, read_size, seed); });
+		bench("read_fixed", n_tasks, [&](::uint32_t seed) { return with_read_fixed(fd, read_size, seed); });
+		bench("pread", n_tasks, [&](::uint32_t seed) { return with_pread(fd, read_size, seed); });
+	}
+
+	::close(fd);
+	::unlink(path.c_str());
+}
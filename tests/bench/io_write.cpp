@@ -0,0 +1,86 @@
+// Sustained write bandwidth of tp::write_file against a blocking fopen/fwrite/fclose on the worker, which is what
+// coroutines had to do before. Every round writes n_files files at once, and the files are overwritten every round.
+// With sync, each file is fdatasync'ed before it counts as written: linked to the write for write_file, and with a
+// blocking ::fdatasync for the baseline.
+// Usage: io_write [directory] [n_files] [file_size_in_KiB] [sync]
+
+#define JPL_HEADER_ONLY
+#include <jpl/thread_pool.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace tp = ::jpl::tp;
+
+constexpr ::uint32_t n_rounds{ 8 };
+
+::std::atomic<::uint64_t> bytes_written;
+
+tp::lazy<void> write_async(const char* path, ::std::span<const ::std::byte> data, bool sync) {
+	co_await tp::write_file(path, data, { .sync = sync ? tp::io_sync::data : tp::io_sync::none });
+	bytes_written += data.size();
+}
+
+tp::lazy<void> write_blocking(const char* path, ::std::span<const ::std::byte> data, bool sync) {
+	::FILE* file = ::fopen(path, "wb");
+	if (!file)
+		co_return;
+	::fwrite(data.data(), 1, data.size(), file);
+	if (sync) {
+		::fflush(file);
+		::fdatasync(::fileno(file));
+	}
+	::fclose(file);
+	bytes_written += data.size();
+	co_return;
+}
+
+template<class F>
+void bench(const char* name, const ::std::vector<::std::string>& paths, ::std::span<const ::std::byte> data, F&& write) {
+	bytes_written = 0;
+	const auto start = tp::clock::now();
+	for (::uint32_t round = 0; round != n_rounds; ++round) {
+		for (const ::std::string& path : paths)
+			tp::spawn(write(path.c_str(), data));
+		tp::join();
+	}
+	const ::std::chrono::duration<double> elapsed = tp::clock::now() - start;
+	const ::uint64_t expected = ::uint64_t(paths.size()) * n_rounds * data.size();
+	if (bytes_written != expected)
+		::fmt::print("wrote {} bytes instead of {}\n", bytes_written.load(), expected);
+	::fmt::print("{:<14} | {:9.3f} ms | {:7.1f} MB/s\n", name, elapsed.count() * 1e3, bytes_written / elapsed.count() * 1e-6);
+}
+
+int main(int argc, char** argv) {
+	const char* dir = argc > 1 ? argv[1] : "/tmp";
+	const ::uint32_t n_files = argc > 2 ? ::uint32_t(::strtoul(argv[2], nullptr, 10)) : 64;
+	const ::size_t file_size = (argc > 3 ? ::strtoull(argv[3], nullptr, 10) : 4096) << 10;
+	const bool sync = argc > 4 && ::strtoul(argv[4], nullptr, 10);
+
+	::std::vector<::std::string> paths;
+	for (::uint32_t i = 0; i != n_files; ++i)
+		paths.push_back(::fmt::format("{}/jpl_io_write_{}_{}", dir, ::getpid(), i));
+	const ::std::vector<::std::byte> data(file_size, ::std::byte{ 'x' });
+
+	{
+		auto handle = tp::init(tp::conf{});
+		bench("fwrite", paths, data, [=](const char* path, ::std::span<const ::std::byte> d) {
+			return write_blocking(path, d, sync);
+		});
+		bench("write_file", paths, data, [=](const char* path, ::std::span<const ::std::byte> d) {
+			return write_async(path, d, sync);
+		});
+	}
+
+	for (const ::std::string& path : paths)
+		::unlink(path.c_str());
+}
@@ -0,0 +1,96 @@
+// Deep co_await chains: tp::lazy (symmetric transfer) against a coroutine type whose every resumption goes through
+// tp::enqueue, which is what hand-written promise types had to do before.
+// Usage: lazy [n_threads]
+
+#define JPL_HEADER_ONLY
+#include <jpl/thread_pool.hpp>
+
+#include <atomic>
+#include <cstdlib>
+
+#include <fmt/format.h>
+
+namespace tp = ::jpl::tp;
+
+// Starting the child and resuming the parent are both separate trips through the task queues
+template<class T>
+struct queued {
+	struct promise_type {
+		T value;
+		::std::coroutine_handle<> continuation;
+
+		queued get_return_object() noexcept {
+			return { ::std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+		static constexpr ::std::suspend_always initial_suspend() noexcept { return {}; }
+		auto final_suspend() noexcept {
+			struct awaiter {
+				static constexpr bool await_ready() noexcept { return false; }
+				void await_suspend(::std::coroutine_handle<promise_type> handle) noexcept {
+					tp::enqueue(handle.promise().continuation);
+				}
+				static constexpr void await_resume() noexcept {}
+			};
+			return awaiter{};
+		}
+		void return_value(T val) noexcept { value = val; }
+		[[noreturn]] static void unhandled_exception() { throw; }
+	};
+
+	::std::coroutine_handle<promise_type> handle;
+
+	queued(::std::coroutine_handle<promise_type> handle) noexcept : handle{ handle } {}
+	queued(queued&& other) noexcept : handle{ other.handle } { other.handle = nullptr; }
+	~queued() { if (handle) handle.destroy(); }
+
+	static constexpr bool await_ready() noexcept { return false; }
+	void await_suspend(::std::coroutine_handle<> awaiting) noexcept {
+		handle.promise().continuation = awaiting;
+		tp::enqueue(::std::coroutine_handle<>{ handle });
+	}
+	T await_resume() noexcept { return handle.promise().value; }
+};
+
+tp::lazy<::uint64_t> lazy_chain(::uint32_t depth) {
+	if (depth == 0)
+		co_return 0;
+	co_return 1 + co_await lazy_chain(depth - 1);
+}
+
+queued<::uint64_t> queued_chain(::uint32_t depth) {
+	if (depth == 0)
+		co_return 0;
+	co_return 1 + co_await queued_chain(depth - 1);
+}
+
+::std::atomic<::uint64_t> sink;
+::std::atomic<bool> done;
+
+template<class Chain>
+tp::lazy<void> run(Chain (*chain)(::uint32_t), ::uint32_t depth, ::uint32_t rounds) {
+	for (::uint32_t round = 0; round != rounds; ++round)
+		sink += co_await chain(depth);
+	done = true;
+	done.notify_one();
+}
+
+template<class Chain>
+void bench(const char* name, Chain (*chain)(::uint32_t), ::uint32_t depth) {
+	const ::uint32_t rounds = 1'000'000 / depth;
+	done = false;
+	const auto start = tp::clock::now();
+	tp::spawn(run(chain, depth, rounds));
+	done.wait(false);
+	const double ns = ::std::chrono::duration<double, ::std::nano>(tp::clock::now() - start).count();
+	::fmt::print("{:>8} | depth {:>7} | {:>8.1f} ns/await\n", name, depth, ns / (double(depth) * rounds));
+}
+
+int main(int argc, char** argv) {
+	const ::size_t n_threads = argc > 1 ? ::size_t(::atoi(argv[1])) : 0;
+	auto handle = tp::init(n_threads);
+
+	for (::uint32_t depth : { 10u, 1'000u, 100'000u }) {
+		bench("lazy"   , lazy_chain  , depth);
+		bench("enqueue", queued_chain, depth);
+	}
+}
@@ -0,0 +1,136 @@
+// Compares jpl::multiqueue against a std::priority_queue behind a std::mutex, with every thread alternating between
+// pushing an element with a random priority and popping one, on a queue that starts out with n_prefill elements.
+// Then it measures how far off the multiqueue's order is: it pops every element of a shuffled set of priorities on
+// one thread, and reports the average and worst rank of the popped element among the ones still in the queue, with
+// 0 being exact.
+// Usage: multiqueue [n_threads]
+
+#include <jpl/multiqueue.hpp>
+#include <jpl/random.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+using clock_type = ::std::chrono::steady_clock;
+
+constexpr ::uint32_t n_prefill{ 1u << 16 };
+constexpr ::uint64_t n_ops{ 1u << 22 };
+
+// Baseline, lowest priority first like the multiqueue
+class locked_queue {
+	using entry = ::std::pair<::uint64_t, ::uint64_t>;
+	::std::mutex mutex;
+	::std::priority_queue<entry, ::std::vector<entry>, ::std::greater<entry>> queue;
+
+	public:
+	void push(::uint64_t priority, ::uint64_t val) {
+		::std::lock_guard lock{ mutex };
+		queue.emplace(priority, val);
+	}
+
+	::std::optional<::uint64_t> try_pop() {
+		::std::lock_guard lock{ mutex };
+		if (queue.empty())
+			return ::std::nullopt;
+		const ::uint64_t val = queue.top().second;
+		queue.pop();
+		return val;
+	}
+};
+
+template<class Queue>
+void bench(const char* name, Queue& queue, ::uint32_t n_threads) {
+	::jpl::pcg32 rng{ 1 };
+	for (::uint32_t i = 0; i != n_prefill; ++i)
+		queue.push(rng(), i);
+
+	::std::vector<::std::thread> threads;
+	const auto start = clock_type::now();
+	for (::uint32_t t = 0; t != n_threads; ++t) {
+		threads.emplace_back([&, t] {
+			::jpl::pcg32 local_rng{ t + 2 };
+			for (::uint64_t i = 0; i != n_ops / n_threads; ++i) {
+				queue.push(local_rng(), i);
+				static_cast<void>(queue.try_pop());
+			}
+		});
+	}
+	for (auto& t : threads)
+		t.join();
+	const ::std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+	::fmt::print("{:<16} {} threads | {:8.3f} ms | {:7.2f} M push+pop/s\n",
+		name, n_threads, elapsed.count() * 1e3, n_ops / elapsed.count() * 1e-6);
+}
+
+// Counts of the priorities still in the queue, for looking up how many lower ones there are
+class fenwick_tree {
+	::std::vector<::uint32_t> tree;
+
+	public:
+	explicit fenwick_tree(::uint32_t n) : tree(n + 1, 0) {}
+
+	void add(::uint32_t i, ::int32_t delta) {
+		for (++i; i < tree.size(); i += i & -i)
+			tree[i] += delta;
+	}
+
+	// Sum of [0, i)
+	::uint32_t prefix(::uint32_t i) const {
+		::uint32_t sum = 0;
+		for (; i; i -= i & -i)
+			sum += tree[i];
+		return sum;
+	}
+};
+
+void rank_error(::uint32_t n_heaps) {
+	constexpr ::uint32_t n{ 1u << 20 };
+	::std::vector<::uint32_t> priorities(n);
+	for (::uint32_t i = 0; i != n; ++i)
+		priorities[i] = i;
+	::std::shuffle(priorities.begin(), priorities.end(), ::jpl::pcg32{ 3 });
+
+	::jpl::multiqueue<::uint32_t, ::uint32_t> queue{ n_heaps };
+	fenwick_tree remaining{ n };
+	for (::uint32_t p : priorities) {
+		queue.push(p, p);
+		remaining.add(p, 1);
+	}
+
+	::uint64_t sum = 0;
+	::uint32_t worst = 0;
+	while (::std::optional<::uint32_t> p = queue.try_pop()) {
+		const ::uint32_t rank = remaining.prefix(*p);
+		sum += rank;
+		worst = rank > worst ? rank : worst;
+		remaining.add(*p, -1);
+	}
+	::fmt::print("{:4} heaps | average rank {:8.2f} | worst rank {:6}\n", n_heaps, double(sum) / n, worst);
+}
+
+int main(int argc, char** argv) {
+	const ::uint32_t n_threads = argc > 1 ? ::uint32_t(::strtoul(argv[1], nullptr, 10)) : 4;
+
+	{
+		auto queue = ::std::make_unique<locked_queue>();
+		bench("mutex + heap", *queue, n_threads);
+	}
+	{
+		auto queue = ::std::make_unique<::jpl::multiqueue<::uint64_t>>(2 * n_threads);
+		bench("multiqueue", *queue, n_threads);
+	}
+
+	for (::uint32_t n_heaps : { 1u, 2u, 8u, 32u, 128u })
+		rank_error(n_heaps);
+}
@@ -0,0 +1,123 @@
+// Scaling of tp::parallel_for and tp::parallel_reduce on memory-bound and compute-bound kernels.
+// Usage: parallel [n_threads]
+// Without an argument, it runs itself with 1, 2, 4, ... threads up to the number of CPUs, since the pool can only be
+// started once per process.
+
+#define JPL_HEADER_ONLY
+#include <jpl/thread_pool.hpp>
+#include <jpl/vector.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <span>
+#include <string>
+#include <thread>
+
+#include <fmt/format.h>
+
+namespace tp = ::jpl::tp;
+
+constexpr ::size_t n_elements{ 1u << 24 };
+constexpr ::uint32_t rounds{ 10 };
+
+// Keeps the compiler from throwing away results
+volatile double sink;
+
+// Returns the best time of a few rounds, in milliseconds
+template<class F>
+double measure(F&& f) {
+	double best = 1e300;
+	for (::uint32_t round = 0; round != rounds; ++round) {
+		const auto start = tp::clock::now();
+		f();
+		const ::std::chrono::duration<double, ::std::milli> elapsed = tp::clock::now() - start;
+		best = elapsed.count() < best ? elapsed.count() : best;
+	}
+	return best;
+}
+
+void report(const char* name, double serial, double parallel) {
+	::fmt::print("{:<26} | serial {:8.3f} ms | parallel {:8.3f} ms | speedup {:5.2f}x\n",
+		name, serial, parallel, serial / parallel);
+}
+
+// Iterates a logistic map, which is all arithmetic and no memory traffic
+double compute(double x, ::uint32_t iterations) noexcept {
+	for (::uint32_t i = 0; i != iterations; ++i)
+		x = 3.9 * x * (1.0 - x);
+	return x;
+}
+
+void run_benchmarks() {
+	::jpl::vector<double> a, b, c;
+	a.resize(::uint32_t(n_elements), 0.0);
+	b.resize(::uint32_t(n_elements), 1.0);
+	c.resize(::uint32_t(n_elements), 2.0);
+	const auto plus = [](double x, double y) { return x + y; };
+
+	// Memory-bound: one load per element
+	report("sum (memory-bound)",
+		measure([&] {
+			double acc = 0.0;
+			for (double x : b) acc += x;
+			sink = acc;
+		}),
+		measure([&] { sink = tp::parallel_reduce(b, 0.0, plus, plus); }));
+
+	// Memory-bound: STREAM triad, two loads and a store per element
+	report("triad (memory-bound)",
+		measure([&] {
+			for (::size_t i = 0; i != n_elements; ++i)
+				a[i] = b[i] + 3.0 * c[i];
+		}),
+		measure([&] {
+			tp::parallel_for(0, n_elements, [&](::size_t i) { a[i] = b[i] + 3.0 * c[i]; });
+		}));
+
+	// Compute-bound, with the same cost for every element
+	constexpr ::size_t n_compute = n_elements / 64;
+	const auto uniform = [](double acc, double x) { return acc + compute(x * 0.25, 200); };
+	report("logistic (compute-bound)",
+		measure([&] {
+			double acc = 0.0;
+			for (::size_t i = 0; i != n_compute; ++i) acc = uniform(acc, b[i]);
+			sink = acc;
+		}),
+		measure([&] {
+			sink = tp::parallel_reduce(::std::span{ b.data(), n_compute }, 0.0, uniform, plus);
+		}));
+
+	// Compute-bound, with the cost growing along the range, so that fixed equal chunks would leave threads idle
+	constexpr ::size_t n_skewed = n_elements / 1024;
+	const auto skewed = [](::size_t i) { return compute(0.25, ::uint32_t(i / 8)); };
+	report("skewed (compute-bound)",
+		measure([&] {
+			double acc = 0.0;
+			for (::size_t i = 0; i != n_skewed; ++i) acc += skewed(i);
+			sink = acc;
+		}),
+		measure([&] {
+			tp::parallel_for(0, n_skewed, [&](::size_t i) { a[i] = skewed(i); });
+		}));
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1) {
+		const ::size_t n_threads = ::strtoul(argv[1], nullptr, 10);
+		auto handle = tp::init(n_threads);
+		::fmt::print("{} threads\n", tp::n_threads());
+		run_benchmarks();
+		return 0;
+	}
+	const ::size_t max_threads = ::std::max(::std::thread::hardware_concurrency(), 1u);
+	for (::size_t n = 1; ; n *= 2) {
+		if (n > max_threads)
+			n = max_threads;
+		const ::std::string command = ::std::string{ argv[0] } + " " + ::std::to_string(n);
+		if (::std::system(command.c_str()) != 0)
+			return 1;
+		if (n == max_threads)
+			break;
+	}
+}
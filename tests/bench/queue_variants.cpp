@@ -0,0 +1,91 @@
+// Compares jpl::spsc_queue and jpl::mpsc_queue against jpl::concurrent_queue used the same way.
+// Throughput: producers push n_items in total, and a single consumer pops them.
+// Latency: two threads bounce a counter back and forth through a pair of queues, and half the round trip is reported.
+// Usage: queue_variants [n_mpsc_producers]
+
+#include <jpl/concurrent_queue.hpp>
+#include <jpl/mpsc_queue.hpp>
+#include <jpl/spsc_queue.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+using clock_type = ::std::chrono::steady_clock;
+
+constexpr ::uint32_t queue_size{ 1024 };
+constexpr ::uint64_t n_items{ 1u << 24 };
+constexpr ::uint64_t n_round_trips{ 1u << 18 };
+
+template<template<class, ::uint32_t, bool> class Queue>
+void bench_throughput(const char* name, ::uint32_t n_producers) {
+	auto queue = ::std::make_unique<Queue<::uint64_t, queue_size, false>>();
+	::std::vector<::std::thread> producers;
+
+	const auto start = clock_type::now();
+	for (::uint32_t i = 0; i != n_producers; ++i) {
+		const ::uint64_t share = n_items / n_producers + (i < n_items % n_producers);
+		producers.emplace_back([&, share] {
+			for (::uint64_t j = 0; j != share; ++j)
+				queue->push(j);
+		});
+	}
+	::uint64_t sum = 0;
+	for (::uint64_t i = 0; i != n_items; ++i)
+		sum += queue->pop();
+	for (auto& t : producers)
+		t.join();
+	const ::std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+	::uint64_t expected = 0;
+	for (::uint32_t i = 0; i != n_producers; ++i) {
+		const ::uint64_t share = n_items / n_producers + (i < n_items % n_producers);
+		expected += share * (share - 1) / 2;
+	}
+	if (sum != expected)
+		::fmt::print("checksum mismatch: {} != {}\n", sum, expected);
+
+	::fmt::print("{:<16} {}P/1C throughput | {:8.3f} ms | {:7.2f} M items/s\n",
+		name, n_producers, elapsed.count() * 1e3, n_items / elapsed.count() * 1e-6);
+}
+
+template<template<class, ::uint32_t, bool> class Queue>
+void bench_latency(const char* name) {
+	auto ping = ::std::make_unique<Queue<::uint64_t, queue_size, false>>();
+	auto pong = ::std::make_unique<Queue<::uint64_t, queue_size, false>>();
+
+	::std::thread echo([&] {
+		for (::uint64_t i = 0; i != n_round_trips; ++i)
+			pong->push(ping->pop() + 1);
+	});
+	const auto start = clock_type::now();
+	::uint64_t value = 0;
+	for (::uint64_t i = 0; i != n_round_trips; ++i) {
+		ping->push(value);
+		value = pong->pop();
+	}
+	const ::std::chrono::duration<double, ::std::nano> elapsed = clock_type::now() - start;
+	echo.join();
+	if (value != n_round_trips)
+		::fmt::print("lost a message: {} != {}\n", value, n_round_trips);
+
+	::fmt::print("{:<16} one-way latency  | {:8.1f} ns\n", name, elapsed.count() / n_round_trips / 2);
+}
+
+int main(int argc, char** argv) {
+	const ::uint32_t n_mpsc_producers = argc > 1 ? ::uint32_t(::strtoul(argv[1], nullptr, 10)) : 4;
+
+	bench_throughput<::jpl::concurrent_queue>("concurrent_queue", 1);
+	bench_throughput<::jpl::spsc_queue>      ("spsc_queue",       1);
+	bench_throughput<::jpl::concurrent_queue>("concurrent_queue", n_mpsc_producers);
+	bench_throughput<::jpl::mpsc_queue>      ("mpsc_queue",       n_mpsc_producers);
+
+	bench_latency<::jpl::concurrent_queue>("concurrent_queue");
+	bench_latency<::jpl::spsc_queue>      ("spsc_queue");
+	bench_latency<::jpl::mpsc_queue>      ("mpsc_queue");
+}
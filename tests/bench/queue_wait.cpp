@@ -0,0 +1,80 @@
+// Compares jpl::concurrent_queue's two ways of blocking, queue_wait::per_slot and queue_wait::eventcount, with blocking
+// push and pop only, and reports how many futex syscalls each made.
+// Usage: queue_wait [max_threads]
+
+// Counts the futex syscalls made by the queue. Has to come before any jpl include.
+#define JPL_COUNT_FUTEX_CALLS
+
+#include <jpl/concurrent_queue.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+using clock_type = ::std::chrono::steady_clock;
+
+constexpr ::uint32_t queue_size{ 1024 };
+constexpr ::uint64_t n_items{ 1u << 22 };
+
+template<::jpl::queue_wait waiting>
+void bench(const char* name, ::uint32_t n_producers, ::uint32_t n_consumers) {
+	using queue_type = ::jpl::concurrent_queue<::uint64_t, queue_size, false, waiting>;
+	auto queue = ::std::make_unique<queue_type>();
+	::std::vector<::uint64_t> checksums(n_consumers);
+	::std::vector<::std::thread> threads;
+
+	::jpl::detail::futex_wait_calls.store(0);
+	::jpl::detail::futex_wake_calls.store(0);
+	const auto start = clock_type::now();
+	for (::uint32_t i = 0; i != n_consumers; ++i) {
+		const ::uint64_t share = n_items / n_consumers + (i < n_items % n_consumers);
+		threads.emplace_back([&, i, share] {
+			::uint64_t sum = 0;
+			for (::uint64_t j = 0; j != share; ++j)
+				sum += queue->pop();
+			checksums[i] = sum;
+		});
+	}
+	for (::uint32_t i = 0; i != n_producers; ++i) {
+		const ::uint64_t share = n_items / n_producers + (i < n_items % n_producers);
+		threads.emplace_back([&, share] {
+			for (::uint64_t j = 0; j != share; ++j)
+				queue->push(j);
+		});
+	}
+	for (auto& t : threads)
+		t.join();
+	const ::std::chrono::duration<double> elapsed = clock_type::now() - start;
+	const ::uint64_t waits = ::jpl::detail::futex_wait_calls.load();
+	const ::uint64_t wakes = ::jpl::detail::futex_wake_calls.load();
+
+	::uint64_t expected = 0, actual = 0;
+	for (::uint32_t i = 0; i != n_producers; ++i) {
+		const ::uint64_t share = n_items / n_producers + (i < n_items % n_producers);
+		expected += share * (share - 1) / 2;
+	}
+	for (::uint64_t sum : checksums)
+		actual += sum;
+	if (actual != expected)
+		::fmt::print("checksum mismatch: {} != {}\n", actual, expected);
+
+	::fmt::print("{:<10} {}P/{}C | {:8.3f} ms | {:7.2f} M items/s | {:9} waits | {:9} wakes | {:6.2f} syscalls per 1k items\n",
+		name, n_producers, n_consumers, elapsed.count() * 1e3, n_items / elapsed.count() * 1e-6,
+		waits, wakes, (waits + wakes) * 1e3 / n_items);
+}
+
+int main(int argc, char** argv) {
+	const ::uint32_t max_threads = argc > 1 ? ::uint32_t(::strtoul(argv[1], nullptr, 10)) : 4;
+
+	const ::std::pair<::uint32_t, ::uint32_t> configs[]{ { 1, 1 }, { 1, max_threads }, { max_threads, 1 }, { max_threads, max_threads } };
+	for (auto [n_producers, n_consumers] : configs) {
+		bench<::jpl::queue_wait::per_slot>  ("per_slot",   n_producers, n_consumers);
+		bench<::jpl::queue_wait::eventcount>("eventcount", n_producers, n_consumers);
+	}
+}
@@ -0,0 +1,90 @@
+// Compares jpl::segmented_queue against jpl::concurrent_queue with the same number of slots per segment as the ring
+// has. Each queue gets an unmeasured warm-up round first, so that the measured round is the steady state, where the
+// segmented queue should be recycling its segments instead of allocating them. How many it still allocated is
+// reported too.
+// Usage: segmented_queue [n_producers] [n_consumers]
+
+#include <jpl/concurrent_queue.hpp>
+#include <jpl/segmented_queue.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+using clock_type = ::std::chrono::steady_clock;
+
+constexpr ::uint32_t n_slots{ 1024 };
+constexpr ::uint64_t n_items{ 1u << 24 };
+
+// Returns the elapsed time in seconds
+template<class Queue>
+double run(Queue& queue, ::uint32_t n_producers, ::uint32_t n_consumers) {
+	::std::vector<::uint64_t> checksums(n_consumers);
+	::std::vector<::std::thread> threads;
+
+	const auto start = clock_type::now();
+	for (::uint32_t i = 0; i != n_consumers; ++i) {
+		const ::uint64_t share = n_items / n_consumers + (i < n_items % n_consumers);
+		threads.emplace_back([&, i, share] {
+			::uint64_t sum = 0;
+			for (::uint64_t j = 0; j != share; ++j)
+				sum += queue.pop();
+			checksums[i] = sum;
+		});
+	}
+	for (::uint32_t i = 0; i != n_producers; ++i) {
+		const ::uint64_t share = n_items / n_producers + (i < n_items % n_producers);
+		threads.emplace_back([&, share] {
+			for (::uint64_t j = 0; j != share; ++j)
+				queue.push(j);
+		});
+	}
+	for (auto& t : threads)
+		t.join();
+	const ::std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+	::uint64_t expected = 0, actual = 0;
+	for (::uint32_t i = 0; i != n_producers; ++i) {
+		const ::uint64_t share = n_items / n_producers + (i < n_items % n_producers);
+		expected += share * (share - 1) / 2;
+	}
+	for (::uint64_t sum : checksums)
+		actual += sum;
+	if (actual != expected)
+		::fmt::print("checksum mismatch: {} != {}\n", actual, expected);
+	return elapsed.count();
+}
+
+template<class Queue>
+void bench(const char* name, ::uint32_t n_producers, ::uint32_t n_consumers) {
+	auto queue = ::std::make_unique<Queue>();
+	::size_t warm_segments = 0;
+	run(*queue, n_producers, n_consumers);
+	if constexpr (requires { queue->allocated_segments(); })
+		warm_segments = queue->allocated_segments();
+	const double elapsed = run(*queue, n_producers, n_consumers);
+
+	::fmt::print("{:<16} {}P/{}C | {:8.3f} ms | {:7.2f} M items/s",
+		name, n_producers, n_consumers, elapsed * 1e3, n_items / elapsed * 1e-6);
+	if constexpr (requires { queue->allocated_segments(); })
+		::fmt::print(" | {} segments after warm-up, {} allocated since", warm_segments, queue->allocated_segments() - warm_segments);
+	::fmt::print("\n");
+}
+
+int main(int argc, char** argv) {
+	const ::uint32_t n_producers = argc > 1 ? ::uint32_t(::strtoul(argv[1], nullptr, 10)) : 2;
+	const ::uint32_t n_consumers = argc > 2 ? ::uint32_t(::strtoul(argv[2], nullptr, 10)) : 2;
+
+	using ring = ::jpl::concurrent_queue<::uint64_t, n_slots, false>;
+	using segmented = ::jpl::segmented_queue<::uint64_t, n_slots, false>;
+
+	bench<ring>     ("concurrent_queue", 1, 1);
+	bench<segmented>("segmented_queue",  1, 1);
+	bench<ring>     ("concurrent_queue", n_producers, n_consumers);
+	bench<segmented>("segmented_queue",  n_producers, n_consumers);
+}
@@ -0,0 +1,101 @@
+// Compares jpl::sharded_queue against a single jpl::concurrent_queue, with producers and consumers pinned to the CPUs
+// of every shard. Besides throughput, it reports how many elements were popped on a different shard than they were
+// pushed on, which on a NUMA machine is the traffic that crosses sockets.
+// On a single node machine, the CPUs are split into 2 shards by default, so it runs there too, though then the
+// numbers only show how much the shards keep apart, not what that saves.
+// Usage: sharded_queue [n_shards] [threads_per_shard]
+
+#include <jpl/concurrent_queue.hpp>
+#include <jpl/sharded_queue.hpp>
+#include <jpl/vector.hpp>
+#include <jpl/bits/topology.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+using clock_type = ::std::chrono::steady_clock;
+
+constexpr ::uint32_t queue_size{ 1024 };
+constexpr ::uint64_t n_items{ 1u << 22 };
+constexpr int shard_shift{ 48 };
+
+using sharded = ::jpl::sharded_queue<::uint64_t, queue_size, false>;
+using single = ::jpl::concurrent_queue<::uint64_t, queue_size, false>;
+
+// Shard of the CPU the calling thread is on
+::uint32_t current_shard(const sharded& layout) {
+	return layout.shard_of_cpu(::jpl::detail::current_cpu());
+}
+
+template<class Queue>
+void bench(const char* name, Queue& queue, const sharded& layout, const ::std::vector<::jpl::vector<::uint32_t>>& shard_cpus, ::uint32_t threads_per_shard) {
+	const ::uint32_t n_threads = ::uint32_t(shard_cpus.size()) * threads_per_shard;
+	::std::atomic<::uint64_t> checksum{ 0 }, crossed{ 0 };
+	::std::vector<::std::thread> threads;
+
+	const auto start = clock_type::now();
+	for (::uint32_t i = 0; i != n_threads; ++i) {
+		const ::uint64_t share = n_items / n_threads + (i < n_items % n_threads);
+		threads.emplace_back([&, share] {
+			::uint64_t sum = 0, n_crossed = 0;
+			for (::uint64_t j = 0; j != share; ++j) {
+				const ::uint64_t item = queue.pop();
+				sum += item & ((::uint64_t(1) << shard_shift) - 1);
+				n_crossed += (item >> shard_shift) != current_shard(layout);
+			}
+			checksum += sum;
+			crossed += n_crossed;
+		});
+		::jpl::detail::set_affinity(threads.back(), shard_cpus[i / threads_per_shard]);
+	}
+	for (::uint32_t i = 0; i != n_threads; ++i) {
+		const ::uint64_t share = n_items / n_threads + (i < n_items % n_threads);
+		threads.emplace_back([&, share] {
+			for (::uint64_t j = 0; j != share; ++j)
+				queue.push((::uint64_t(current_shard(layout)) << shard_shift) | j);
+		});
+		::jpl::detail::set_affinity(threads.back(), shard_cpus[i / threads_per_shard]);
+	}
+	for (auto& t : threads)
+		t.join();
+	const ::std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+	::uint64_t expected = 0;
+	for (::uint32_t i = 0; i != n_threads; ++i) {
+		const ::uint64_t share = n_items / n_threads + (i < n_items % n_threads);
+		expected += share * (share - 1) / 2;
+	}
+	if (checksum != expected)
+		::fmt::print("checksum mismatch: {} != {}\n", checksum.load(), expected);
+
+	::fmt::print("{:<16} {} shards x {}P/{}C | {:8.3f} ms | {:7.2f} M items/s | {:5.1f}% popped on another shard\n",
+		name, shard_cpus.size(), threads_per_shard, threads_per_shard, elapsed.count() * 1e3,
+		n_items / elapsed.count() * 1e-6, crossed.load() * 100.0 / n_items);
+}
+
+int main(int argc, char** argv) {
+	const ::uint32_t n_nodes = ::jpl::detail::read_topology().n_nodes;
+	const ::uint32_t n_shards = argc > 1 ? ::uint32_t(::strtoul(argv[1], nullptr, 10)) : (n_nodes > 1 ? n_nodes : 2);
+	const ::uint32_t threads_per_shard = argc > 2 ? ::uint32_t(::strtoul(argv[2], nullptr, 10)) : 2;
+
+	auto sharded_queue = ::std::make_unique<sharded>(n_shards);
+	auto single_queue = ::std::make_unique<single>();
+
+	// Threads are pinned to their shard's CPUs, or left alone if the shard didn't get any
+	::std::vector<::jpl::vector<::uint32_t>> shard_cpus(sharded_queue->n_shards());
+	const ::jpl::detail::topology topo = ::jpl::detail::read_topology();
+	for (::uint32_t cpu = 0; cpu != topo.cpu_node.size(); ++cpu)
+		if (topo.cpu_node[cpu] != ::jpl::detail::no_node)
+			shard_cpus[sharded_queue->shard_of_cpu(cpu)].push_back(cpu);
+
+	::fmt::print("{} NUMA nodes\n", n_nodes);
+	bench("concurrent_queue", *single_queue, *sharded_queue, shard_cpus, threads_per_shard);
+	bench("sharded_queue", *sharded_queue, *sharded_queue, shard_cpus, threads_per_shard);
+}
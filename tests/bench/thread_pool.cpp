@@ -0,0 +1,63 @@
+// Throughput benchmarks for jpl::tp.
+// Build once as is, and once with -DJPL_TP_GLOBAL_QUEUE_ONLY to compare against the single shared task queue.
+// Usage: thread_pool [n_threads]
+
+#define JPL_HEADER_ONLY
+#include <jpl/thread_pool.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <utility>
+
+#include <fmt/format.h>
+
+namespace tp = ::jpl::tp;
+
+// Every task spawns `width` children until `depth` runs out. Leaves count down `remaining`, and the last one
+// wakes up the main thread, which is the fan-in.
+::std::atomic<::uint64_t> remaining;
+::std::atomic<bool> done;
+
+void fan_out(::uint32_t depth, ::uint32_t width) {
+	if (depth == 0) {
+		if (remaining.fetch_sub(1, ::std::memory_order::acq_rel) == 1) {
+			done = true;
+			done.notify_one();
+		}
+		return;
+	}
+	for (::uint32_t i = 0; i != width; ++i)
+		tp::enqueue([=]{ fan_out(depth - 1, width); });
+}
+
+void bench_fan_out(::uint32_t depth, ::uint32_t width, ::uint32_t rounds) {
+	::uint64_t n_tasks = 0, n_leaves = 1;
+	for (::uint32_t i = 0; i <= depth; ++i, n_leaves *= width)
+		n_tasks += n_leaves;
+	n_leaves /= width;
+
+	const auto start = tp::clock::now();
+	for (::uint32_t round = 0; round != rounds; ++round) {
+		remaining = n_leaves;
+		done = false;
+		tp::enqueue([=]{ fan_out(depth, width); });
+		done.wait(false);
+	}
+	const ::std::chrono::duration<double> elapsed = tp::clock::now() - start;
+	n_tasks *= rounds;
+
+	::fmt::print("fan-out depth {:2} width {:4} | {:9} tasks | {:8.3f} ms | {:6.2f} M tasks/s\n",
+		depth, width, n_tasks, elapsed.count() * 1e3, n_tasks / elapsed.count() * 1e-6);
+}
+
+int main(int argc, char** argv) {
+	const ::size_t n_threads = argc > 1 ? ::strtoul(argv[1], nullptr, 10) : 0;
+	auto handle = tp::init(n_threads);
+
+	bench_fan_out(10,    2, 1000);
+	bench_fan_out( 3,   12, 1000);
+	bench_fan_out( 1, 1500, 1000);
+	// Bursts that don't fit in the shared ring buffer, and have to go through the overflow list
+	bench_fan_out( 2, 2000,    5);
+	bench_fan_out( 1, 1'000'000, 5);
+}
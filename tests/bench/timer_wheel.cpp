@@ -0,0 +1,95 @@
+// Compares jpl::tp's timer wheel against the std::priority_queue + std::mutex it replaced,
+// with 1k, 100k and 1M pending timers.
+
+#include <jpl/bits/thread_pool/timer_wheel.hpp>
+#include <jpl/random.hpp>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <utility>
+
+#include <fmt/format.h>
+
+namespace tp = ::jpl::tp;
+using namespace ::std::chrono_literals;
+
+double ns_per_op(tp::clock::time_point start, ::size_t n) {
+	return ::std::chrono::duration<double, ::std::nano>(tp::clock::now() - start).count() / n;
+}
+
+void bench_wheel(::size_t n) {
+	::jpl::pcg32 rng{ 42 };
+	auto wheel = ::std::make_unique<tp::detail::timer_wheel>();
+	auto nodes = ::std::make_unique<tp::detail::timer_node[]>(n);
+	const tp::clock::time_point base = tp::clock::now();
+	::size_t n_fired = 0;
+	auto sink = [&](tp::task&&) noexcept { ++n_fired; };
+
+	auto start = tp::clock::now();
+	for (::size_t i = 0; i != n; ++i) {
+		nodes[i].t = []{};
+		// Never let the nodes be deleted, since they're not individually heap allocated
+		nodes[i].refs = 3;
+		wheel->schedule(&nodes[i], base + ::std::chrono::milliseconds{ 1 + rng() % 3'600'000 }, i);
+	}
+	wheel->process(base, sink);
+	const double insert = ns_per_op(start, n);
+
+	start = tp::clock::now();
+	for (::size_t i = 0; i < n; i += 2)
+		wheel->cancel(&nodes[i]);
+	wheel->process(base, sink);
+	const double cancel = ns_per_op(start, n / 2);
+
+	start = tp::clock::now();
+	wheel->process(base + 2h, sink);
+	const double expire = ns_per_op(start, n_fired);
+
+	::fmt::print("wheel          | {:8} timers | insert {:7.1f} ns | cancel {:7.1f} ns | expire {:7.1f} ns\n",
+		n, insert, cancel, expire);
+	tp::detail::pending_tasks = 0;
+}
+
+void bench_priority_queue(::size_t n) {
+	struct timed_task {
+		tp::task t;
+		tp::clock::time_point queue_at;
+		bool operator<(const timed_task& other) const noexcept { return queue_at > other.queue_at; }
+	};
+	::jpl::pcg32 rng{ 42 };
+	::std::mutex m;
+	::std::priority_queue<timed_task> queue;
+	const tp::clock::time_point base = tp::clock::now();
+
+	auto start = tp::clock::now();
+	for (::size_t i = 0; i != n; ++i) {
+		::std::lock_guard lock{ m };
+		queue.push(timed_task{ []{}, base + ::std::chrono::milliseconds{ 1 + rng() % 3'600'000 } });
+	}
+	const double insert = ns_per_op(start, n);
+
+	start = tp::clock::now();
+	::size_t n_fired = 0;
+	{
+		::std::lock_guard lock{ m };
+		while (!queue.empty() && queue.top().queue_at < base + 2h) {
+			tp::task t = static_cast<tp::task&&>(const_cast<tp::task&>(queue.top().t));
+			queue.pop();
+			++n_fired;
+		}
+	}
+	const double expire = ns_per_op(start, n_fired);
+
+	::fmt::print("priority_queue | {:8} timers | insert {:7.1f} ns | cancel     n/a    | expire {:7.1f} ns\n",
+		n, insert, expire);
+	tp::detail::pending_tasks = 0;
+}
+
+int main() {
+	for (::size_t n : { 1'000, 100'000, 1'000'000 }) {
+		bench_wheel(n);
+		bench_priority_queue(n);
+	}
+}
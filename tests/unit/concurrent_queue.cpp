@@ -0,0 +1,138 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <jpl/concurrent_queue.hpp>
+
+using namespace std::chrono_literals;
+
+template<jpl::queue_wait waiting>
+using small_queue = jpl::concurrent_queue<int, 4, true, waiting>;
+
+TEST_CASE("push and pop in order") {
+	jpl::concurrent_queue<int, 256> queue;
+	for (int i = 0; i != 100; ++i)
+		queue.push(i);
+	for (int i = 0; i != 100; ++i)
+		CHECK(queue.pop() == i);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("ring smaller than a shuffle period goes around many times") {
+	small_queue<jpl::queue_wait::per_slot> queue;
+	for (int lap = 0; lap != 100; ++lap) {
+		for (int i = 0; i != 4; ++i)
+			CHECK(queue.try_push(lap * 4 + i));
+		CHECK(!queue.try_push(-1));
+		for (int i = 0; i != 4; ++i)
+			CHECK(queue.try_pop() == lap * 4 + i);
+		CHECK(!queue.try_pop());
+	}
+}
+
+TEST_CASE("pop_bulk takes what's ready, in order") {
+	jpl::concurrent_queue<int, 256> queue;
+	const int values[]{ 1, 2, 3, 4, 5 };
+	queue.push_bulk(std::begin(values), std::end(values));
+	std::vector<int> out;
+	CHECK(queue.pop_bulk(std::back_inserter(out), 3) == 3);
+	CHECK(queue.pop_bulk(std::back_inserter(out), 10) == 2);
+	CHECK(queue.pop_bulk(std::back_inserter(out), 10) == 0);
+	CHECK(out == std::vector<int>{ 1, 2, 3, 4, 5 });
+}
+
+// The producer has to wait for slots of its own batch, which only the consumer can free
+template<jpl::queue_wait waiting>
+void push_bulk_bigger_than_ring() {
+	small_queue<waiting> queue;
+	std::vector<int> values(64);
+	for (int i = 0; i != 64; ++i)
+		values[i] = i;
+	std::vector<int> consumed;
+	std::thread consumer{ [&] {
+		for (int i = 0; i != 64; ++i)
+			consumed.push_back(queue.pop());
+	} };
+	// Give the consumer time to block in pop
+	std::this_thread::sleep_for(10ms);
+	queue.push_bulk(values.begin(), values.end());
+	consumer.join();
+	CHECK(consumed == values);
+}
+
+TEST_CASE("push_bulk bigger than the ring, with a consumer blocked in pop") {
+	SUBCASE("per_slot") { push_bulk_bigger_than_ring<jpl::queue_wait::per_slot>(); }
+	SUBCASE("eventcount") { push_bulk_bigger_than_ring<jpl::queue_wait::eventcount>(); }
+}
+
+// Moving it takes a while if it's marked slow, so that a push can still be publishing its element while a later one
+// is done already
+struct slow_move {
+	int value;
+	bool slow;
+	slow_move(int value, bool slow) noexcept : value{ value }, slow{ slow } {}
+	slow_move(slow_move&& other) noexcept : value{ other.value }, slow{ other.slow } {
+		if (slow)
+			std::this_thread::sleep_for(50ms);
+	}
+};
+
+TEST_CASE("eventcount: elements published out of turn order all reach blocked consumers") {
+	jpl::concurrent_queue<slow_move, 256, true, jpl::queue_wait::eventcount> queue;
+	std::atomic<int> consumed{ 0 };
+	std::vector<std::thread> consumers;
+	for (int i = 0; i != 2; ++i) {
+		consumers.emplace_back([&] {
+			if (queue.pop().value >= 0)
+				++consumed;
+		});
+	}
+	// Both consumers are asleep by now, and the fast push gets a later turn, but publishes before the slow one
+	std::this_thread::sleep_for(20ms);
+	std::thread slow_producer{ [&] { queue.push(slow_move{ 0, true }); } };
+	std::this_thread::sleep_for(10ms);
+	queue.push(slow_move{ 1, false });
+	slow_producer.join();
+	for (int i = 0; i != 100 && consumed != 2; ++i)
+		std::this_thread::sleep_for(10ms);
+	CHECK(consumed == 2);
+	// Unblocks whoever missed out, so that the test fails instead of hanging
+	for (int i = consumed; i != 2; ++i)
+		queue.push(slow_move{ -1, false });
+	for (std::thread& consumer : consumers)
+		consumer.join();
+}
+
+template<jpl::queue_wait waiting>
+void mpmc() {
+	constexpr int n_threads{ 4 };
+	constexpr int per_thread{ 20000 };
+	jpl::concurrent_queue<int, 128, true, waiting> queue;
+	std::atomic<std::int64_t> sum{ 0 };
+	std::vector<std::thread> threads;
+	for (int t = 0; t != n_threads; ++t) {
+		threads.emplace_back([&] {
+			for (int i = 1; i <= per_thread; ++i)
+				queue.push(i);
+		});
+		threads.emplace_back([&] {
+			std::int64_t local = 0;
+			for (int i = 0; i != per_thread; ++i)
+				local += queue.pop();
+			sum += local;
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	CHECK(sum == std::int64_t(n_threads) * per_thread * (per_thread + 1) / 2);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("mpmc") {
+	SUBCASE("per_slot") { mpmc<jpl::queue_wait::per_slot>(); }
+	SUBCASE("eventcount") { mpmc<jpl::queue_wait::eventcount>(); }
+}
@@ -0,0 +1,84 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include <jpl/mpsc_queue.hpp>
+
+TEST_CASE("push and pop in order") {
+	jpl::mpsc_queue<int, 256> queue;
+	for (int i = 0; i != 100; ++i)
+		queue.push(i);
+	for (int i = 0; i != 100; ++i)
+		CHECK(queue.pop() == i);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("try_push fails when full, and try_pop when empty") {
+	jpl::mpsc_queue<int, 4> queue;
+	int out = -1;
+	CHECK(!queue.try_pop());
+	CHECK(!queue.try_pop(out));
+	CHECK(out == -1);
+	for (int i = 0; i != 4; ++i)
+		CHECK(queue.try_push(i));
+	CHECK(!queue.try_push(4));
+	CHECK(queue.try_pop(out));
+	CHECK(out == 0);
+	CHECK(queue.try_push(4));
+	for (int i = 1; i != 5; ++i)
+		CHECK(queue.try_pop() == i);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("turns wrap around the ring many times") {
+	jpl::mpsc_queue<int, 4> queue;
+	for (int lap = 0; lap != 1000; ++lap) {
+		for (int i = 0; i != 3; ++i)
+			CHECK(queue.try_push(lap * 3 + i));
+		for (int i = 0; i != 3; ++i)
+			CHECK(queue.try_pop() == lap * 3 + i);
+	}
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("destructor destroys what's left") {
+	jpl::mpsc_queue<std::string, 8> queue;
+	for (int i = 0; i != 6; ++i)
+		queue.push(std::string(100, char('a' + i)));
+	CHECK(queue.pop() == std::string(100, 'a'));
+}
+
+// A small ring, so that producers keep blocking on the consumer and the other way around. Every producer's elements
+// have to come out in the order it pushed them.
+TEST_CASE("producer threads and a consumer") {
+	constexpr int n_producers{ 4 };
+	constexpr int per_producer{ 50000 };
+	jpl::mpsc_queue<std::uint32_t, 16> queue;
+	std::vector<std::thread> producers;
+	for (std::uint32_t p = 0; p != n_producers; ++p) {
+		producers.emplace_back([&queue, p] {
+			for (std::uint32_t i = 0; i != per_producer; ++i) {
+				if (i % 2)
+					queue.push(p << 24 | i);
+				else
+					while (!queue.try_push(p << 24 | i))
+						std::this_thread::yield();
+			}
+		});
+	}
+	std::uint32_t next[n_producers]{};
+	bool in_order = true;
+	for (int i = 0; i != n_producers * per_producer; ++i) {
+		const std::uint32_t val = queue.pop();
+		in_order = in_order && (val & 0xffffff) == next[val >> 24]++;
+	}
+	for (std::thread& producer : producers)
+		producer.join();
+	CHECK(in_order);
+	for (std::uint32_t count : next)
+		CHECK(count == per_producer);
+	CHECK(!queue.try_pop());
+}
@@ -0,0 +1,93 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+#include <jpl/multiqueue.hpp>
+
+TEST_CASE("a single heap pops in priority order") {
+	jpl::multiqueue<int> queue{ 1 };
+	CHECK(queue.heap_count() == 1);
+	const std::uint64_t priorities[]{ 5, 3, 9, 1, 7, 3 };
+	for (std::uint64_t priority : priorities)
+		queue.push(priority, int(priority));
+	for (int expected : { 1, 3, 3, 5, 7, 9 })
+		CHECK(queue.try_pop() == expected);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("try_pop finds the last element, whichever heap it's in") {
+	jpl::multiqueue<int> queue{ 64 };
+	for (int i = 0; i != 100; ++i) {
+		queue.push(0, i);
+		CHECK(queue.try_pop() == i);
+		CHECK(!queue.try_pop());
+	}
+}
+
+// With two choices, the rank of a popped element among the ones still in the queue stays around the number of heaps
+TEST_CASE("one thread pops roughly in priority order") {
+	constexpr int n{ 4000 };
+	constexpr std::uint32_t n_heaps{ 8 };
+	jpl::multiqueue<int> queue{ n_heaps };
+	std::vector<int> priorities(n);
+	std::iota(priorities.begin(), priorities.end(), 0);
+	std::shuffle(priorities.begin(), priorities.end(), std::mt19937{ 1 });
+	for (int priority : priorities)
+		queue.push(std::uint64_t(priority), priority);
+
+	std::set<int> left(priorities.begin(), priorities.end());
+	std::int64_t total_rank = 0;
+	for (int i = 0; i != n; ++i) {
+		const std::optional<int> val = queue.try_pop();
+		REQUIRE(val);
+		const auto it = left.find(*val);
+		REQUIRE(it != left.end());
+		total_rank += std::distance(left.begin(), it);
+		left.erase(it);
+	}
+	CHECK(left.empty());
+	CHECK(!queue.try_pop());
+	CHECK(total_rank / n < 4 * n_heaps);
+}
+
+TEST_CASE("every element is popped exactly once with concurrent pushes and pops") {
+	constexpr int n_threads{ 4 };
+	constexpr int per_thread{ 20000 };
+	jpl::multiqueue<int> queue{ 8 };
+	const auto seen = std::make_unique<std::atomic<int>[]>(n_threads * per_thread);
+	std::atomic<int> n_popped{ 0 };
+	std::vector<std::thread> threads;
+	for (int t = 0; t != n_threads; ++t) {
+		threads.emplace_back([&, t] {
+			std::mt19937 rng(t);
+			for (int i = 0; i != per_thread; ++i)
+				queue.push(rng(), t * per_thread + i);
+		});
+		threads.emplace_back([&] {
+			while (n_popped < n_threads * per_thread) {
+				if (const std::optional<int> val = queue.try_pop()) {
+					++seen[*val];
+					++n_popped;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	int n_once = 0;
+	for (int i = 0; i != n_threads * per_thread; ++i)
+		n_once += seen[i] == 1;
+	CHECK(n_once == n_threads * per_thread);
+	CHECK(!queue.try_pop());
+}
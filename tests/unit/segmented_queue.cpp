@@ -0,0 +1,160 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include <jpl/segmented_queue.hpp>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("push and pop in order") {
+	jpl::segmented_queue<int, 4> queue;
+	for (int i = 0; i != 10; ++i)
+		queue.push(i);
+	for (int i = 0; i != 10; ++i)
+		CHECK(queue.pop() == i);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("a segment is appended by the first push past the last one") {
+	jpl::segmented_queue<int, 4> queue;
+	CHECK(queue.allocated_segments() == 1);
+	for (int i = 0; i != 4; ++i)
+		queue.push(i);
+	CHECK(queue.allocated_segments() == 1);
+	queue.push(4);
+	CHECK(queue.allocated_segments() == 2);
+	for (int i = 5; i != 16; ++i)
+		queue.push(i);
+	CHECK(queue.allocated_segments() == 4);
+	for (int i = 0; i != 16; ++i)
+		CHECK(queue.pop() == i);
+}
+
+TEST_CASE("consumed segments are retired onto the freelist and reused") {
+	jpl::segmented_queue<int, 4> queue;
+	int next_push = 0, next_pop = 0;
+	const auto round = [&] {
+		for (int i = 0; i != 16; ++i)
+			queue.push(next_push++);
+		for (int i = 0; i != 16; ++i)
+			CHECK(queue.pop() == next_pop++);
+	};
+	for (int i = 0; i != 4; ++i)
+		round();
+	const std::size_t allocated = queue.allocated_segments();
+	CHECK(allocated <= 6);
+	for (int i = 0; i != 1000; ++i)
+		round();
+	CHECK(queue.allocated_segments() == allocated);
+}
+
+TEST_CASE("try_pop leaves the queue untouched when it's empty") {
+	jpl::segmented_queue<int, 4> queue;
+	int out = -1;
+	CHECK(!queue.try_pop(out));
+	CHECK(out == -1);
+	queue.push(1);
+	CHECK(queue.try_pop(out));
+	CHECK(out == 1);
+	CHECK(!queue.try_pop());
+	// Across a segment boundary
+	for (int i = 0; i != 6; ++i)
+		queue.push(i);
+	for (int i = 0; i != 6; ++i)
+		CHECK(queue.try_pop() == i);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("destructor destroys what's left, in linked and recycled segments") {
+	jpl::segmented_queue<std::string, 4> queue;
+	for (int i = 0; i != 16; ++i)
+		queue.push(std::string(100, char('a' + i)));
+	for (int i = 0; i != 10; ++i)
+		CHECK(queue.pop() == std::string(100, char('a' + i)));
+}
+
+// Tiny segments, so that they're appended and retired all the time, and hints keep pointing at recycled ones
+template<std::uint32_t segment_size>
+void mpmc(bool blocking) {
+	constexpr int n_threads{ 4 };
+	constexpr int per_thread{ 50000 };
+	jpl::segmented_queue<int, segment_size> queue;
+	std::atomic<std::int64_t> sum{ 0 };
+	std::vector<std::thread> threads;
+	for (int t = 0; t != n_threads; ++t) {
+		threads.emplace_back([&] {
+			for (int i = 1; i <= per_thread; ++i)
+				queue.push(i);
+		});
+		threads.emplace_back([&] {
+			std::int64_t local = 0;
+			for (int i = 0; i != per_thread; ++i) {
+				if (blocking) {
+					local += queue.pop();
+				} else {
+					int val = 0;
+					while (!queue.try_pop(val))
+						std::this_thread::yield();
+					local += val;
+				}
+			}
+			sum += local;
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	CHECK(sum == std::int64_t(n_threads) * per_thread * (per_thread + 1) / 2);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("mpmc across many segments") {
+	SUBCASE("pop, 2 slots per segment") { mpmc<2>(true); }
+	SUBCASE("pop, 64 slots per segment") { mpmc<64>(true); }
+	SUBCASE("try_pop, 2 slots per segment") { mpmc<2>(false); }
+	SUBCASE("try_pop, 64 slots per segment") { mpmc<64>(false); }
+}
+
+// More consumers than there are elements most of the time, so that pops wait for the next segment to be appended,
+// while the segments they wait on are appended, consumed, retired and recycled under them
+TEST_CASE("pops waiting for a segment that gets recycled") {
+	constexpr int n_producers{ 4 };
+	constexpr int n_consumers{ 8 };
+	constexpr int per_producer{ 20000 };
+	jpl::segmented_queue<int, 2> queue;
+	std::atomic<std::int64_t> sum{ 0 };
+	std::atomic<int> n_done{ 0 };
+	std::vector<std::thread> threads;
+	for (int t = 0; t != n_consumers; ++t) {
+		threads.emplace_back([&] {
+			std::int64_t local = 0;
+			for (int i = 0; i != n_producers * per_producer / n_consumers; ++i)
+				local += queue.pop();
+			sum += local;
+			++n_done;
+		});
+	}
+	for (int t = 0; t != n_producers; ++t) {
+		threads.emplace_back([&] {
+			for (int i = 1; i <= per_producer; ++i) {
+				queue.push(i);
+				if (i % 64 == 0)
+					std::this_thread::yield();
+			}
+		});
+	}
+	// A hang fails the test instead of blocking it forever
+	for (int i = 0; i != 3000 && n_done != n_consumers; ++i)
+		std::this_thread::sleep_for(10ms);
+	CHECK(n_done == n_consumers);
+	if (n_done != n_consumers)
+		for (int i = 0; i != n_producers * per_producer; ++i)
+			queue.push(0);
+	for (std::thread& thread : threads)
+		thread.join();
+	CHECK(sum == std::int64_t(n_producers) * per_producer * (per_producer + 1) / 2);
+}
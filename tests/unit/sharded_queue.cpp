@@ -0,0 +1,100 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <jpl/sharded_queue.hpp>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("one shard is a FIFO queue") {
+	jpl::sharded_queue<int, 256> queue{ 1 };
+	CHECK(queue.n_shards() == 1);
+	for (int i = 0; i != 100; ++i)
+		queue.push(i);
+	for (int i = 0; i != 100; ++i)
+		CHECK(queue.pop() == i);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("pushes go to the other shards when the local one is full") {
+	jpl::sharded_queue<int, 4> queue{ 2 };
+	CHECK(queue.capacity() == 8);
+	for (int i = 0; i != 8; ++i)
+		CHECK(queue.try_push(i));
+	CHECK(!queue.try_push(8));
+	std::int64_t sum = 0;
+	for (int i = 0; i != 8; ++i) {
+		int val = -1;
+		CHECK(queue.try_pop(val));
+		sum += val;
+	}
+	CHECK(sum == 28);
+	CHECK(!queue.try_pop());
+}
+
+// Moving it takes a while if it's marked slow, so that a push can still be publishing its element while a later one
+// is done already
+struct slow_move {
+	int value;
+	bool slow;
+	slow_move(int value, bool slow) noexcept : value{ value }, slow{ slow } {}
+	slow_move(slow_move&& other) noexcept : value{ other.value }, slow{ other.slow } {
+		if (slow)
+			std::this_thread::sleep_for(50ms);
+	}
+};
+
+TEST_CASE("elements published out of turn order all reach blocked consumers") {
+	jpl::sharded_queue<slow_move, 256> queue{ 1 };
+	std::atomic<int> consumed{ 0 };
+	std::vector<std::thread> consumers;
+	for (int i = 0; i != 2; ++i) {
+		consumers.emplace_back([&] {
+			if (queue.pop().value >= 0)
+				++consumed;
+		});
+	}
+	// Both consumers are asleep by now, and the fast push gets a later turn, but publishes before the slow one
+	std::this_thread::sleep_for(20ms);
+	std::thread slow_producer{ [&] { queue.push(slow_move{ 0, true }); } };
+	std::this_thread::sleep_for(10ms);
+	std::thread fast_producer{ [&] { queue.push(slow_move{ 1, false }); } };
+	slow_producer.join();
+	fast_producer.join();
+	for (int i = 0; i != 100 && consumed != 2; ++i)
+		std::this_thread::sleep_for(10ms);
+	CHECK(consumed == 2);
+	// Unblocks whoever missed out, so that the test fails instead of hanging
+	for (int i = consumed; i != 2; ++i)
+		queue.push(slow_move{ -1, false });
+	for (std::thread& consumer : consumers)
+		consumer.join();
+}
+
+TEST_CASE("mpmc") {
+	constexpr int n_threads{ 4 };
+	constexpr int per_thread{ 20000 };
+	jpl::sharded_queue<int, 128> queue{ 2 };
+	std::atomic<std::int64_t> sum{ 0 };
+	std::vector<std::thread> threads;
+	for (int t = 0; t != n_threads; ++t) {
+		threads.emplace_back([&] {
+			for (int i = 1; i <= per_thread; ++i)
+				queue.push(i);
+		});
+		threads.emplace_back([&] {
+			std::int64_t local = 0;
+			for (int i = 0; i != per_thread; ++i)
+				local += queue.pop();
+			sum += local;
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	CHECK(sum == std::int64_t(n_threads) * per_thread * (per_thread + 1) / 2);
+	CHECK(!queue.try_pop());
+}
@@ -0,0 +1,72 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <jpl/spsc_queue.hpp>
+
+TEST_CASE("push and pop in order") {
+	jpl::spsc_queue<int, 256> queue;
+	for (int i = 0; i != 100; ++i)
+		queue.push(i);
+	for (int i = 0; i != 100; ++i)
+		CHECK(queue.pop() == i);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("try_push fails when full, and try_pop when empty") {
+	jpl::spsc_queue<int, 4> queue;
+	int out = -1;
+	CHECK(!queue.try_pop());
+	CHECK(!queue.try_pop(out));
+	CHECK(out == -1);
+	for (int i = 0; i != 4; ++i)
+		CHECK(queue.try_push(i));
+	CHECK(!queue.try_push(4));
+	CHECK(queue.try_pop(out));
+	CHECK(out == 0);
+	CHECK(queue.try_push(4));
+	for (int i = 1; i != 5; ++i)
+		CHECK(queue.try_pop() == i);
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("indices wrap around the ring many times") {
+	jpl::spsc_queue<int, 4> queue;
+	for (int lap = 0; lap != 1000; ++lap) {
+		for (int i = 0; i != 3; ++i)
+			CHECK(queue.try_push(lap * 3 + i));
+		for (int i = 0; i != 3; ++i)
+			CHECK(queue.try_pop() == lap * 3 + i);
+	}
+	CHECK(!queue.try_pop());
+}
+
+TEST_CASE("destructor destroys what's left") {
+	jpl::spsc_queue<std::string, 8> queue;
+	for (int i = 0; i != 6; ++i)
+		queue.push(std::string(100, char('a' + i)));
+	CHECK(queue.pop() == std::string(100, 'a'));
+}
+
+// A small ring, so that both sides keep blocking on each other
+TEST_CASE("producer and consumer threads") {
+	constexpr int n{ 200000 };
+	jpl::spsc_queue<int, 16> queue;
+	std::int64_t sum = 0;
+	bool in_order = true;
+	std::thread consumer{ [&] {
+		for (int i = 0; i != n; ++i) {
+			const int val = queue.pop();
+			in_order = in_order && val == i;
+			sum += val;
+		}
+	} };
+	for (int i = 0; i != n; ++i)
+		queue.push(i);
+	consumer.join();
+	CHECK(in_order);
+	CHECK(sum == std::int64_t(n) * (n - 1) / 2);
+	CHECK(!queue.try_pop());
+}